@@ -0,0 +1,84 @@
+//appending chunks to a file through an append handle against the same
+//chunks sent by path (insert >>), for a file in the root and one 10 levels down
+//usage: bench/append [bytes per run]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//one run appends total bytes to a new file in dir, by path or through a handle
+uint64_t _append(vfs_session_t* s, const char* dir, bool handle, const uint8_t* data, size_t chunk, size_t total)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/f", dir);
+    vfs_touch(s, path);
+
+    int fd;
+    if(handle) vfs_open(s, path, _APPEND, &fd);
+    uint64_t t0 = _now_ns();
+    for(size_t k = 0; k < total / chunk; k++)
+    {
+        if(handle) vfs_pwrite(s, fd, VFS_CURRENT, data, chunk);
+        else       vfs_insert(s, path, data, chunk, true);
+    }
+    uint64_t ns = _now_ns() - t0;
+    if(handle) vfs_close(s, fd);
+
+    vfs_rm(s, path);
+    return ns;
+}
+
+//best of three, alternating so neither side profits from a warmer allocator
+void _run(vfs_session_t* s, const char* dir, const char* where, size_t chunk, size_t total)
+{
+    uint8_t* data = malloc(chunk);
+    memset(data, 'x', chunk);
+
+    uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+    for(int round = 0; round < 3; round++)
+    {
+        for(int handle = 0; handle < 2; handle++)
+        {
+            uint64_t ns = _append(s, dir, handle, data, chunk, total);
+            if(ns < best[handle]) best[handle] = ns;
+        }
+    }
+    free(data);
+
+    size_t chunks = total / chunk;
+    printf("%-5s chunk %5zu B: insert >> %10.0f chunks/s %8.1f MB/s   handle %10.0f chunks/s %8.1f MB/s\n",
+           where, chunk, chunks / (best[0] / 1e9), chunk * chunks / (best[0] / 1e3),
+           chunks / (best[1] / 1e9), chunk * chunks / (best[1] / 1e3));
+}
+
+int main(int argc, char** argv)
+{
+    size_t total = (argc > 1) ? strtoul(argv[1], NULL, 10) : (16u << 20);
+
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    for(int d = 0; d < 10; d++)
+    {
+        vfs_mkdir(s, "d");
+        vfs_cd(s, "d");
+    }
+    vfs_cd(s, "/");
+
+    printf("%zu bytes per run\n", total);
+    size_t chunks[] = { 16, 256, 4096 };
+    for(size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+    {
+        _run(s, "", "root", chunks[k], total);
+        _run(s, "/d/d/d/d/d/d/d/d/d/d", "deep", chunks[k], total);
+    }
+    vfs_destroy(fs);
+    return 0;
+}
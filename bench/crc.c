@@ -0,0 +1,80 @@
+//throughput of the crc32c kernel: verify of a single file from 4 KiB to 64 MiB recomputes
+//its whole checksum, and the cost of keeping the checksum current while a file grows by appends
+//usage: bench/crc [largest file in MiB]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//the kernel vfs_create picks on this cpu
+const char* _kernel()
+{
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2")) return "sse4.2 crc32";
+#endif
+    return "slicing-by-8";
+}
+
+int main(int argc, char** argv)
+{
+    size_t largest = ((argc > 1) ? strtoul(argv[1], NULL, 10) : 64) << 20;
+
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    uint8_t*       data = malloc(largest);
+    for(size_t k = 0; k < largest; k++)
+    {
+        data[k] = (uint8_t)(k * 2654435761u >> 13);
+    }
+    vfs_mkdir(s, "v");
+    vfs_touch(s, "/v/f");
+    printf("kernel: %s\n", _kernel());
+
+    //an overwrite drops the checksum, a write into the emptied file extends it over the
+    //whole file, and verify recomputes all of it
+    for(size_t size = 4096; size <= largest; size *= 4)
+    {
+        vfs_insert(s, "/v/f", NULL, 0, false);
+        vfs_insert(s, "/v/f", data, size, false);
+
+        size_t   rounds = (256u << 20) / size;
+        uint64_t t0     = _now_ns();
+        for(size_t r = 0; r < rounds; r++)
+        {
+            vfs_verify(s, "/v", NULL, NULL, NULL);
+        }
+        uint64_t ns = _now_ns() - t0;
+        printf("verify %8zu KiB: %8.2f GB/s %10.1f us per file\n", size >> 10,
+               (double)size * rounds / ns, ns / 1e3 / rounds);
+    }
+
+    //appends extend the checksum by the new bytes only, whatever the size of the file
+    size_t chunk = 4096;
+    vfs_insert(s, "/v/f", NULL, 0, false);
+    for(size_t size = 0, report = 1u << 20; size + chunk <= largest; size += chunk)
+    {
+        uint32_t crc;
+        uint64_t t0 = _now_ns();
+        vfs_insert(s, "/v/f", data + size, chunk, true);
+        vfs_checksum(s, "/v/f", &crc);
+        uint64_t ns = _now_ns() - t0;
+        if(size + chunk == report)
+        {
+            printf("append 4 KiB + cksum at %8zu KiB: %8.1f us\n", report >> 10, ns / 1e3);
+            report *= 4;
+        }
+    }
+
+    free(data);
+    vfs_destroy(fs);
+    return 0;
+}
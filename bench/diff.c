@@ -0,0 +1,177 @@
+//diff of two trees of about 1M nodes each that differ in a handful of files: the first diff
+//that computes every hash, a repeated one, one after a few more writes, and a plain walk
+//that compares every listing and every file as a client had to before
+//usage: bench/diff [nodes per tree] [changed files]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+#define FANOUT 100
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//FANOUT directories of FANOUT directories of files, every file holds its number
+size_t _build(vfs_session_t* s, const char* root, size_t nodes)
+{
+    char   name[64];
+    size_t made = 1, files = (nodes + FANOUT * FANOUT - 1) / (FANOUT * FANOUT);
+    vfs_cd(s, "/");
+    vfs_mkdir(s, root);
+    for(int d = 0; d < FANOUT; d++)
+    {
+        snprintf(name, sizeof(name), "/%s", root);
+        vfs_cd(s, name);
+        snprintf(name, sizeof(name), "d%d", d);
+        vfs_mkdir(s, name);
+        vfs_cd(s, name);
+        made++;
+        for(int e = 0; e < FANOUT; e++)
+        {
+            snprintf(name, sizeof(name), "e%d", e);
+            vfs_mkdir(s, name);
+            vfs_cd(s, name);
+            made++;
+            for(size_t f = 0; f < files; f++, made++)
+            {
+                uint64_t number = ((uint64_t)d * FANOUT + e) * files + f;
+                snprintf(name, sizeof(name), "f%zu", f);
+                vfs_touch(s, name);
+                vfs_insert(s, name, (const uint8_t*)&number, sizeof(number), false);
+            }
+            vfs_cd(s, "..");
+        }
+    }
+    vfs_cd(s, "/");
+    return made;
+}
+
+//overwrite count files of root spread over the tree, seed makes them differ from earlier rounds
+void _change(vfs_session_t* s, const char* root, size_t files, int count, uint64_t seed)
+{
+    char path[96];
+    for(int k = 0; k < count; k++)
+    {
+        int d = (k * 37 + (int)seed) % FANOUT, e = (k * 53 + (int)seed) % FANOUT;
+        snprintf(path, sizeof(path), "/%s/d%d/e%d/f%zu", root, d, e, (size_t)k % files);
+        uint64_t value = seed << 32 | (uint64_t)k;
+        vfs_insert(s, path, (const uint8_t*)&value, sizeof(value), false);
+    }
+}
+
+int _count(event_types type, const char* path, void* ctx)
+{
+    (void)type;
+    (void)path;
+    (*(size_t*)ctx)++;
+    return 0;
+}
+
+typedef struct
+{
+    char     names[FANOUT * FANOUT][32];
+    bool     dir[FANOUT * FANOUT];
+    size_t   count;
+} listing;
+
+int _collect(const vfs_entry_t* entry, void* ctx)
+{
+    listing* l = ctx;
+    if(l->count == FANOUT * FANOUT) return 1;
+    strcpy(l->names[l->count], entry->name);
+    l->dir[l->count] = (entry->type == _DIR);
+    l->count++;
+    return 0;
+}
+
+//what a client did before: list both sides, then compare file by file and go down every directory
+size_t _walk(vfs_session_t* s, const char* a, const char* b)
+{
+    listing* la = malloc(sizeof(listing));
+    listing* lb = malloc(sizeof(listing));
+    la->count = lb->count = 0;
+    vfs_cd(s, a);
+    vfs_ls(s, _collect, la);
+    vfs_cd(s, b);
+    vfs_ls(s, _collect, lb);
+
+    size_t differ = 0;
+    char   pa[256], pb[256];
+    for(size_t k = 0; k < la->count; k++)
+    {
+        size_t m = 0;
+        while(m < lb->count && strcmp(la->names[k], lb->names[m]) != 0)
+        {
+            m++;
+        }
+        if(m == lb->count || la->dir[k] != lb->dir[m])
+        {
+            differ++;
+            continue;
+        }
+
+        snprintf(pa, sizeof(pa), "%s/%s", a, la->names[k]);
+        snprintf(pb, sizeof(pb), "%s/%s", b, lb->names[m]);
+        if(la->dir[k])
+        {
+            differ += _walk(s, pa, pb);
+            continue;
+        }
+
+        const uint8_t *da, *db;
+        size_t         na, nb;
+        vfs_read(s, pa, &da, &na);
+        vfs_read(s, pb, &db, &nb);
+        if(na != nb || memcmp(da, db, na) != 0) differ++;
+    }
+    differ += lb->count > la->count ? lb->count - la->count : 0;
+
+    free(la);
+    free(lb);
+    return differ;
+}
+
+void _diff(vfs_session_t* s, const char* label)
+{
+    size_t   found = 0;
+    uint64_t t0    = _now_ns();
+    vfs_diff(s, "/a", "/b", _count, &found);
+    printf("%-34s %10.2f ms  %zu differences\n", label, (_now_ns() - t0) / 1e6, found);
+}
+
+int main(int argc, char** argv)
+{
+    size_t nodes   = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    int    changes = (argc > 2) ? atoi(argv[2]) : 5;
+
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    uint64_t       t0 = _now_ns();
+    size_t         made  = _build(s, "a", nodes);
+    _build(s, "b", nodes);
+    size_t         files = (nodes + FANOUT * FANOUT - 1) / (FANOUT * FANOUT);
+    printf("2 trees of %zu nodes built in %.1f s, %d files changed in b\n", made, (_now_ns() - t0) / 1e9, changes);
+
+    _change(s, "b", files, changes, 1);
+    _diff(s, "first diff (hashes computed)");
+    _diff(s, "repeated diff");
+
+    _change(s, "b", files, changes, 2);
+    _diff(s, "after changing files again");
+
+    _change(s, "a", files, changes, 2);
+    _diff(s, "after the same change in a");
+
+    t0 = _now_ns();
+    size_t found = _walk(s, "/a", "/b");
+    printf("%-34s %10.2f ms  %zu differences\n", "walk comparing every file", (_now_ns() - t0) / 1e6, found);
+
+    vfs_destroy(fs);
+    return 0;
+}
@@ -0,0 +1,143 @@
+//1000 tenants as 1000 vfs_t instances in one process against 1000 processes with one instance each
+//usage: bench/instances [tenants] [files per tenant]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//proportional set size in KiB, shared pages are split between the processes mapping them
+long _pss_kib()
+{
+    FILE* in = fopen("/proc/self/smaps_rollup", "r");
+    if(!in) return -1;
+
+    char line[256];
+    long kib = -1;
+    while(fgets(line, sizeof(line), in))
+    {
+        if(sscanf(line, "Pss: %ld kB", &kib) == 1) break;
+    }
+    fclose(in);
+    return kib;
+}
+
+long _rss_kib()
+{
+    FILE* in = fopen("/proc/self/statm", "r");
+    if(!in) return -1;
+
+    long size, resident = -1;
+    if(fscanf(in, "%ld %ld", &size, &resident) != 2) resident = -1;
+    fclose(in);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+//what one tenant does: a few directories of small files, every file written and read back
+void _workload(vfs_session_t* s, int files)
+{
+    char name[32];
+    char text[64];
+    memset(text, 'x', sizeof(text));
+
+    for(int k = 0; k < files; k++)
+    {
+        if(k % 100 == 0)
+        {
+            snprintf(name, sizeof(name), "/d%d", k / 100);
+            vfs_cd(s, "/");
+            vfs_mkdir(s, name + 1);
+            vfs_cd(s, name);
+        }
+        snprintf(name, sizeof(name), "f%d", k);
+        vfs_touch(s, name);
+        vfs_insert(s, name, (const uint8_t*)text, sizeof(text), false);
+
+        const uint8_t* data;
+        size_t len;
+        vfs_read(s, name, &data, &len);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int tenants = (argc > 1) ? atoi(argv[1]) : 1000;
+    int files   = (argc > 2) ? atoi(argv[2]) : 100;
+
+    printf("%d tenants x %d files\n", tenants, files);
+
+    //one process per tenant, all alive at once like forked tenants would be;
+    //this runs first, so the children do not inherit the heap of the instances below
+    int report[2], release[2];
+    if(pipe(report) != 0 || pipe(release) != 0) return 1;
+
+    uint64_t t3 = _now_ns();
+    for(int k = 0; k < tenants; k++)
+    {
+        pid_t pid = fork();
+        if(pid < 0) return 1;
+        if(pid == 0)
+        {
+            close(report[0]);
+            close(release[1]);
+            vfs_t* fs = vfs_create();
+            _workload(vfs_session_open(fs), files);
+
+            long sizes[2] = { _pss_kib(), _rss_kib() };
+            if(write(report[1], sizes, sizeof(sizes)) != sizeof(sizes)) _exit(1);
+
+            char c;
+            while(read(release[0], &c, 1) > 0);
+            vfs_destroy(fs);
+            _exit(0);
+        }
+    }
+    close(report[1]);
+    close(release[0]);
+
+    long pss = 0, rss = 0, sizes[2];
+    for(int k = 0; k < tenants; k++)
+    {
+        if(read(report[0], sizes, sizeof(sizes)) != sizeof(sizes)) return 1;
+        pss += sizes[0];
+        rss += sizes[1];
+    }
+    uint64_t t4 = _now_ns();
+    close(release[1]);
+    while(wait(NULL) > 0);
+    uint64_t t5 = _now_ns();
+
+    printf("processes: setup+work %8.1f ms  teardown %7.1f ms  memory %8ld KiB pss (%ld KiB rss)\n",
+           (t4 - t3) / 1e6, (t5 - t4) / 1e6, pss, rss);
+
+    //one process, many instances
+    long     rss0 = _rss_kib();
+    uint64_t t0   = _now_ns();
+    vfs_t**  all  = malloc(tenants * sizeof(vfs_t*));
+    for(int k = 0; k < tenants; k++)
+    {
+        all[k] = vfs_create();
+        _workload(vfs_session_open(all[k]), files);
+    }
+    uint64_t t1   = _now_ns();
+    long     rss1 = _rss_kib();
+    for(int k = 0; k < tenants; k++)
+    {
+        vfs_destroy(all[k]);
+    }
+    uint64_t t2 = _now_ns();
+    free(all);
+
+    printf("instances: setup+work %8.1f ms  teardown %7.1f ms  memory %8ld KiB\n",
+           (t1 - t0) / 1e6, (t2 - t1) / 1e6, rss1 - rss0);
+    return 0;
+}
@@ -0,0 +1,76 @@
+//path lookup with permission checks on every directory passed: a read by absolute path at
+//depth 1 to 100 with the traversal cache warm, and right after a chmod at the top made it stale
+//usage: bench/lookup [rounds]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+#define DEPTH 100
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    //a chain of DEPTH directories with a file at every level, created by a casual user
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    char           paths[DEPTH + 1][DEPTH * 4 + 8];
+    char           dir[DEPTH * 4 + 8] = "";
+    for(int d = 1; d <= DEPTH; d++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "d%d", d % 10);
+        vfs_mkdir(s, name);
+        vfs_cd(s, name);
+        vfs_touch(s, "f");
+        vfs_insert(s, "f", (const uint8_t*)"x", 1, false);
+
+        strcat(dir, "/");
+        strcat(dir, name);
+        snprintf(paths[d], sizeof(paths[d]), "%s/f", dir);
+    }
+    vfs_cd(s, "/");
+    printf("%d directories deep, casual user, %d rounds\n", DEPTH, rounds);
+
+    int depths[] = { 1, 10, 50, 100 };
+    for(size_t k = 0; k < sizeof(depths) / sizeof(depths[0]); k++)
+    {
+        const char*    path = paths[depths[k]];
+        const uint8_t* data;
+        size_t         len;
+
+        uint64_t t0 = _now_ns();
+        for(int r = 0; r < rounds; r++)
+        {
+            vfs_read(s, path, &data, &len);
+        }
+        uint64_t t1 = _now_ns();
+
+        //every chmod starts a new generation, the next walk refills the cache of each directory
+        int      stale = rounds / 10;
+        uint64_t spent = 0;
+        for(int r = 0; r < stale; r++)
+        {
+            vfs_chmod(s, "/d1", (r & 1) ? 075 : 077);
+            uint64_t t2 = _now_ns();
+            vfs_read(s, path, &data, &len);
+            spent += _now_ns() - t2;
+        }
+
+        printf("depth %3d: cached %8.1f ns  after chmod %8.1f ns  (%5.1f ns per level cached)\n",
+               depths[k], (double)(t1 - t0) / rounds, (double)spent / stale,
+               (double)(t1 - t0) / rounds / depths[k]);
+    }
+
+    vfs_destroy(fs);
+    return 0;
+}
@@ -0,0 +1,110 @@
+//paged listing of one directory of 10M entries: the time to the first page, right after the
+//directory was filled and once warm, against a full listing; then a page of 100 entries resumed
+//from cursors at growing depth, before and after half of the entries are removed
+//usage: bench/ls_page [files]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int _count(const vfs_entry_t* entry, void* ctx)
+{
+    (void)entry;
+    (*(size_t*)ctx)++;
+    return 0;
+}
+
+//files are created in order, so the one at position p of the listing has sequence number files - p
+//and the page starting there has cursor files - p + 1
+void _pages(vfs_session_t* s, size_t files, const char* label)
+{
+    //the first page, once as the first read of the directory and then as the best of many
+    size_t   listed = 0;
+    uint64_t next;
+    uint64_t t0 = _now_ns();
+    vfs_ls_page(s, 0, 100, false, _count, &listed, &next);
+    uint64_t first = _now_ns() - t0;
+    uint64_t best  = UINT64_MAX;
+    for(int r = 0; r < 1000; r++)
+    {
+        t0 = _now_ns();
+        vfs_ls_page(s, 0, 100, false, _count, &listed, &next);
+        uint64_t ns = _now_ns() - t0;
+        if(ns < best) best = ns;
+    }
+    printf("%-16s first page of 100:               %8.2f us first, %.2f us warm\n", label, first / 1e3, best / 1e3);
+
+    double where[] = { 0.0, 0.0001, 0.5, 0.999 };
+    for(size_t k = 0; k < sizeof(where) / sizeof(where[0]); k++)
+    {
+        size_t   position = (size_t)(where[k] * files);
+        uint64_t cursor   = files - position + 1;
+        int      rounds   = 1000;
+        size_t   listed   = 0;
+        uint64_t next;
+
+        uint64_t t0 = _now_ns();
+        for(int r = 0; r < rounds; r++)
+        {
+            vfs_ls_page(s, cursor, 100, false, _count, &listed, &next);
+        }
+        uint64_t t1 = _now_ns();
+        printf("%-16s page of 100 at position %8zu: %8.2f us (%zu listed)\n",
+               label, position, (t1 - t0) / 1e3 / rounds, listed / rounds);
+    }
+
+    //every page of the directory, one after the other, and the same in one listing
+    uint64_t cursor = 0;
+    listed = 0;
+    t0     = _now_ns();
+    do
+    {
+        vfs_ls_page(s, cursor, 100, false, _count, &listed, &next);
+        cursor = next;
+    } while(cursor);
+    uint64_t t1 = _now_ns();
+    printf("%-16s all pages of 100:                %8.2f ms (%zu listed)\n", label, (t1 - t0) / 1e6, listed);
+
+    listed = 0;
+    t0     = _now_ns();
+    vfs_ls(s, _count, &listed);
+    t1 = _now_ns();
+    printf("%-16s whole listing:                   %8.2f ms (%zu listed)\n", label, (t1 - t0) / 1e6, listed);
+}
+
+int main(int argc, char** argv)
+{
+    size_t files = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    char           name[32];
+    uint64_t       t0 = _now_ns();
+    vfs_mkdir(s, "big");
+    vfs_cd(s, "big");
+    for(size_t k = 0; k < files; k++)
+    {
+        snprintf(name, sizeof(name), "f%zu", k);
+        vfs_touch(s, name);
+    }
+    printf("%zu files in one directory, made in %.1f s\n", files, (_now_ns() - t0) / 1e9);
+    _pages(s, files, "all present");
+
+    //every second file removed, the cursors still point between the survivors
+    for(size_t k = 0; k < files; k += 2)
+    {
+        snprintf(name, sizeof(name), "f%zu", k);
+        vfs_rm(s, name);
+    }
+    _pages(s, files, "half removed");
+    vfs_destroy(fs);
+    return 0;
+}
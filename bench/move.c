@@ -0,0 +1,135 @@
+//move-heavy workloads: small subtrees at the bottom of a depth-1000 tree,
+//and subtrees of growing size moved back and forth below the root
+//usage: bench/move [depth] [moves]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//a directory X below cwd holding nodes - 1 more nodes, in folders of 1000 files
+void _subtree(vfs_session_t* s, size_t nodes)
+{
+    char name[32];
+    vfs_mkdir(s, "X");
+    vfs_cd(s, "X");
+    size_t made = 1;
+    for(int dir = 0; made < nodes; dir++)
+    {
+        snprintf(name, sizeof(name), "d%d", dir);
+        vfs_mkdir(s, name);
+        vfs_cd(s, name);
+        made++;
+        for(int k = 0; k < 999 && made < nodes; k++, made++)
+        {
+            snprintf(name, sizeof(name), "f%d", k);
+            vfs_touch(s, name);
+        }
+        vfs_cd(s, "..");
+    }
+    vfs_cd(s, "..");
+}
+
+int main(int argc, char** argv)
+{
+    int depth = (argc > 1) ? atoi(argv[1]) : 1000;
+    int moves = (argc > 2) ? atoi(argv[2]) : 10000;
+
+    //a chain of depth directories with A, B and an 11 node X at the bottom
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    for(int k = 0; k < depth; k++)
+    {
+        vfs_mkdir(s, "c");
+        vfs_cd(s, "c");
+    }
+    char* bottom = vfs_getcwd(s);
+    size_t len = strlen(bottom);
+    char* to_a = malloc(len + 3);
+    char* to_b = malloc(len + 3);
+    sprintf(to_a, "%s/A", bottom);
+    sprintf(to_b, "%s/B", bottom);
+
+    vfs_mkdir(s, "A");
+    vfs_mkdir(s, "B");
+    vfs_cd(s, "A");
+    _subtree(s, 11);
+
+    //cwd stays in A or B, the destination is an absolute path of depth + 1 names
+    int      failed = 0;
+    uint64_t t0     = _now_ns();
+    for(int k = 0; k < moves; k++)
+    {
+        failed += (vfs_move(s, "X", (k % 2 == 0) ? to_b : to_a) != _OK);
+        vfs_cd(s, "..");
+        vfs_cd(s, (k % 2 == 0) ? "B" : "A");
+    }
+    uint64_t t1 = _now_ns();
+    printf("depth %d, 11 node subtree:   %8.2f us per move (path lookups included, %d failed)\n",
+           depth, (t1 - t0) / 1e3 / moves, failed);
+
+    //the same moves in one transaction: the path to the root is copied by the first move
+    //only, so the difference is what copying the path costs a move committed on its own
+    failed = 0;
+    uint64_t t6 = _now_ns();
+    vfs_begin(s);
+    for(int k = 0; k < moves; k++)
+    {
+        failed += (vfs_move(s, "X", (k % 2 == 0) ? to_b : to_a) != _OK);
+        vfs_cd(s, "..");
+        vfs_cd(s, (k % 2 == 0) ? "B" : "A");
+    }
+    vfs_commit(s);
+    uint64_t t7 = _now_ns();
+    printf("depth %d, one transaction:   %8.2f us per move (path lookups included, %d failed)\n",
+           depth, (t7 - t6) / 1e3 / moves, failed);
+
+    //moving a directory below itself is refused by comparing labels
+    vfs_cd(s, "/");
+    uint64_t t2 = _now_ns();
+    int refused = 0;
+    for(int k = 0; k < moves; k++)
+    {
+        refused += (vfs_move(s, "c", to_a) == _INVALID_ARGUMENTS);
+    }
+    uint64_t t3 = _now_ns();
+    printf("depth %d, cycle rejected:    %8.2f us per move (%d refused)\n",
+           depth, (t3 - t2) / 1e3 / moves, refused);
+    vfs_destroy(fs);
+
+    //a subtree of k nodes moved between /A and /B: the labels of its 2k tags are rewritten
+    size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    for(size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++)
+    {
+        fs = vfs_create();
+        s  = vfs_session_open(fs);
+        vfs_mkdir(s, "A");
+        vfs_mkdir(s, "B");
+        vfs_cd(s, "A");
+        _subtree(s, sizes[n]);
+
+        int rounds = (sizes[n] >= 100000) ? 20 : 200;
+        failed = 0;
+        uint64_t t4 = _now_ns();
+        for(int k = 0; k < rounds; k++)
+        {
+            vfs_cd(s, (k % 2 == 0) ? "/A" : "/B");
+            failed += (vfs_move(s, "X", (k % 2 == 0) ? "/B" : "/A") != _OK);
+        }
+        uint64_t t5 = _now_ns();
+        printf("%8zu node subtree:         %8.2f us per move (%d failed)\n",
+               sizes[n], (t5 - t4) / 1e3 / rounds, failed);
+        vfs_destroy(fs);
+    }
+    free(bottom);
+    free(to_a);
+    free(to_b);
+    return 0;
+}
@@ -0,0 +1,224 @@
+//a large ls in text, binary and json output: what the shell sends in bytes and MB/s, and what
+//it costs a client to parse the listing back into entries. Drives the shell with a script of
+//touch commands followed by ls commands; run it from the top of the tree after make
+//usage: bench/output [files] [listings] [shell]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+//binary records, see "Output for Programs" in the README
+#define FIELD_ENTRY 1
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct
+{
+    char   name[32];
+    size_t size;
+    bool   dir;
+} entry;
+
+typedef struct
+{
+    char*  bytes;
+    size_t len;
+    size_t cap;
+} capture;
+
+//run the shell on script and keep everything it writes; returns the ns from the moment the
+//output grew past mark bytes until the shell ended
+uint64_t _run(const char* shell, const char* mode, FILE* script, size_t mark, capture* out)
+{
+    int from[2];
+    if(pipe(from) != 0) return 0;
+
+    rewind(script);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        dup2(fileno(script), STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(from[0]);
+        execl(shell, shell, mode, (char*)NULL);
+        _exit(127);
+    }
+    close(from[1]);
+
+    uint64_t t0 = 0;
+    out->len = 0;
+    while(true)
+    {
+        if(out->cap - out->len < 65536)
+        {
+            out->cap   = out->cap ? 2 * out->cap : (1u << 20);
+            out->bytes = realloc(out->bytes, out->cap);
+        }
+        ssize_t got = read(from[0], out->bytes + out->len, out->cap - out->len);
+        if(got <= 0) break;
+        out->len += (size_t)got;
+        if(!t0 && out->len > mark) t0 = _now_ns();
+    }
+    close(from[0]);
+    waitpid(pid, NULL, 0);
+    return t0 ? _now_ns() - t0 : 0;
+}
+
+//>name    (Size:N) Mode:Casual rwxr-x, one per line, each command's output after a prompt
+size_t _parse_text(const char* at, const char* end, entry* out)
+{
+    size_t count = 0;
+    while(at < end)
+    {
+        const char* eol = memchr(at, '\n', end - at);
+        if(!eol) break;
+        while(at + 1 < eol && at[0] == '/' && at[1] == '$')
+        {
+            at += 2;
+        }
+
+        const char* gap = memchr(at, ' ', eol - at);
+        if(gap && (at[0] == '>' || at[0] == '-'))
+        {
+            entry* e = &out[count++];
+            size_t n = gap - at - 1;
+            memcpy(e->name, at + 1, n);
+            e->name[n] = '\0';
+            e->dir     = (at[0] == '>');
+            e->size    = strtoull(gap + 10, NULL, 10);
+        }
+        at = eol + 1;
+    }
+    return count;
+}
+
+//records: u64 length, i32 status, fields; entries are tag, u64 id, u8 type,
+//u64 size, u8 owner, u8 mode, u8 name length, name. Names are shorter than 32 bytes and
+//_run leaves room behind the output, so a fixed size copy never reads past the buffer
+size_t _parse_binary(const char* at, const char* end, entry* out)
+{
+    size_t count = 0;
+    while(at + 12 <= end)
+    {
+        uint64_t length;
+        memcpy(&length, at, sizeof(length));
+        const char* field = at + 12;
+        const char* next  = at + 8 + length;
+        while(field < next && field[0] == FIELD_ENTRY)
+        {
+            entry*  e = &out[count++];
+            uint8_t n = (uint8_t)field[20];
+            e->dir = (field[9] == 0);
+            memcpy(&e->size, field + 10, sizeof(uint64_t));
+            memcpy(e->name, field + 21, sizeof(e->name));
+            e->name[n] = '\0';
+            field += 21 + n;
+        }
+        at = next;
+    }
+    return count;
+}
+
+//{"entries":[{"name":"f1","id":3,"type":"file","size":0,...},...],"status":0,...} per line;
+//names of this bench need no escapes
+size_t _parse_json(const char* at, const char* end, entry* out)
+{
+    size_t count = 0;
+    while(at < end && (at = memchr(at, '{', end - at)))
+    {
+        if(strncmp(at, "{\"name\":\"", 9) != 0)
+        {
+            at++;
+            continue;
+        }
+        entry*      e    = &out[count++];
+        const char* name = at + 9;
+        const char* q    = memchr(name, '"', end - name);
+        memcpy(e->name, name, q - name);
+        e->name[q - name] = '\0';
+
+        const char* type = strstr(q, "\"type\":\"");
+        e->dir  = (type[8] == 'd');
+        const char* size = strstr(type, "\"size\":");
+        e->size = strtoull(size + 7, (char**)&at, 10);
+    }
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    size_t      files    = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000;
+    int         listings = (argc > 2) ? atoi(argv[2]) : 100;
+    const char* shell    = (argc > 3) ? argv[3] : "./vfs";
+
+    //the same tree in every run: files with a few bytes each, then the listings;
+    //exit -f leaves freeing the tree to the OS, so the time after the listings is small
+    FILE* setup = tmpfile();
+    FILE* full  = tmpfile();
+    for(size_t k = 0; k < files; k++)
+    {
+        fprintf(setup, "touch file%zu\ninsert > file%zu #%zu\n", k, k, k);
+        fprintf(full, "touch file%zu\ninsert > file%zu #%zu\n", k, k, k);
+    }
+    for(int k = 0; k < listings; k++)
+    {
+        fprintf(full, "ls\n");
+    }
+    fprintf(full, "exit -f\n");
+    fflush(setup);
+    fflush(full);
+
+    const char* modes[]  = { "--output=text", "--output=binary", "--output=json" };
+    size_t (*parse[])(const char*, const char*, entry*) = { _parse_text, _parse_binary, _parse_json };
+    entry*  entries = malloc(files * listings * sizeof(entry));
+    capture before = {0}, after = {0};
+
+    printf("%d listings of %zu files\n", listings, files);
+    for(int m = 0; m < 3; m++)
+    {
+        //the output of the setup starts every run, the listings are timed from the first
+        //byte behind it; text output is buffered, at most a buffer of the setup comes late
+        _run(shell, modes[m], setup, SIZE_MAX, &before);
+        uint64_t listed = UINT64_MAX;
+        for(int r = 0; r < 3; r++)
+        {
+            uint64_t ns = _run(shell, modes[m], full, before.len, &after);
+            if(ns < listed) listed = ns;
+        }
+
+        const char* start = after.bytes + before.len;
+        const char* end   = after.bytes + after.len;
+        size_t      bytes = end - start;
+
+        uint64_t best   = UINT64_MAX;
+        size_t   parsed = 0;
+        for(int r = 0; r < 5; r++)
+        {
+            uint64_t t0 = _now_ns();
+            parsed = parse[m](start, end, entries);
+            uint64_t ns = _now_ns() - t0;
+            if(ns < best) best = ns;
+        }
+
+        double ls_ns = listed ? (double)listed : 1.0;
+        printf("%-16s %6.1f B/entry  ls %7.2f ms %7.1f MB/s   parse %6.1f ns/entry %7.1f MB/s  (%zu entries)\n",
+               modes[m] + 9, (double)bytes / (files * listings), ls_ns / 1e6 / listings, bytes / (ls_ns / 1e3),
+               (double)best / (parsed ? parsed : 1), bytes / (best / 1e3), parsed);
+    }
+
+    free(entries);
+    free(before.bytes);
+    free(after.bytes);
+    fclose(setup);
+    fclose(full);
+    return 0;
+}
@@ -0,0 +1,169 @@
+//copying a 64 KiB to 16 MiB file with print! a | insert > b against the manual way: print! a,
+//take the contents to the client and send them back with insert > b and insert >> b lines.
+//Drives the shell with scripts, a run of the copies minus a run of the setup alone gives their
+//time; run it from the top of the tree after make
+//usage: bench/pipeline [largest file in MiB] [shell]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+//insert takes at most 1023 bytes of content
+#define LINE_DATA 1023
+#define ROUNDS    5
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//run the shell on script and drain what it writes, keeping the last bytes in tail;
+//returns the ns the shell took
+uint64_t _run(const char* shell, FILE* script, char* tail, size_t tail_len)
+{
+    int from[2];
+    if(pipe(from) != 0) return 0;
+
+    rewind(script);
+    uint64_t t0  = _now_ns();
+    pid_t    pid = fork();
+    if(pid == 0)
+    {
+        dup2(fileno(script), STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(from[0]);
+        execl(shell, shell, (char*)NULL);
+        _exit(127);
+    }
+    close(from[1]);
+
+    char   chunk[65536];
+    size_t kept = 0;
+    memset(tail, 0, tail_len);
+    while(true)
+    {
+        ssize_t got = read(from[0], chunk, sizeof(chunk));
+        if(got <= 0) break;
+
+        size_t n = (size_t)got < tail_len ? (size_t)got : tail_len;
+        size_t keep = (kept + n > tail_len) ? tail_len - n : kept;
+        memmove(tail, tail + kept - keep, keep);
+        memcpy(tail + keep, chunk + got - n, n);
+        kept = keep + n;
+    }
+    close(from[0]);
+    waitpid(pid, NULL, 0);
+    return _now_ns() - t0;
+}
+
+uint64_t _best(const char* shell, FILE* script, char* tail, size_t tail_len)
+{
+    uint64_t best = UINT64_MAX;
+    for(int r = 0; r < 3; r++)
+    {
+        uint64_t ns = _run(shell, script, tail, tail_len);
+        if(ns < best) best = ns;
+    }
+    return best;
+}
+
+//a of size bytes, made of 512 bytes of text doubled by appending the file to itself
+void _setup(FILE* script, const uint8_t* line, size_t size)
+{
+    fprintf(script, "touch a\ntouch b\ninsert > a #%.512s\n", (const char*)line);
+    for(size_t have = 512; have < size; have *= 2)
+    {
+        fprintf(script, "print! a | insert >> a\n");
+    }
+}
+
+//the two checksums at the end of the output have to match
+bool _same(const char* tail)
+{
+    const char* b = strstr(tail, " b\n");
+    const char* a = strstr(tail, " a\n");
+    return a && b && a - tail >= 8 && b - tail >= 8 && memcmp(a - 8, b - 8, 8) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t      largest = ((argc > 1) ? strtoul(argv[1], NULL, 10) : 16) << 20;
+    const char* shell   = (argc > 2) ? argv[2] : "./vfs";
+
+    uint8_t line[513];
+    for(size_t k = 0; k < 512; k++)
+    {
+        line[k] = 'a' + k % 26;
+    }
+    line[512] = '\0';
+
+    char tail[256];
+    for(size_t size = 64u << 10; size <= largest; size *= 4)
+    {
+        FILE* setup    = tmpfile();
+        FILE* pipeline = tmpfile();
+        FILE* manual   = tmpfile();
+        _setup(setup, line, size);
+        _setup(pipeline, line, size);
+        _setup(manual, line, size);
+        fprintf(setup, "exit -f\n");
+
+        for(int r = 0; r < ROUNDS; r++)
+        {
+            fprintf(pipeline, "print! a | insert > b\n");
+
+            //the contents come back to the client with print! a; its insert lines are written
+            //up front here, the client knows what a holds
+            fprintf(manual, "print! a\n");
+            for(size_t at = 0; at < size; at += LINE_DATA)
+            {
+                size_t part = (size - at < LINE_DATA) ? size - at : LINE_DATA;
+                fprintf(manual, "insert %s b #", at ? ">>" : ">");
+                for(size_t k = 0; k < part; k++)
+                {
+                    fputc(line[(at + k) % 512], manual);
+                }
+                fputc('\n', manual);
+            }
+        }
+        fflush(pipeline);
+        fflush(manual);
+        long timed[2] = { ftell(pipeline), ftell(manual) };
+        fprintf(pipeline, "exit -f\n");
+        fprintf(manual, "exit -f\n");
+        fflush(setup);
+        fflush(pipeline);
+        fflush(manual);
+
+        uint64_t base = _best(shell, setup, tail, sizeof(tail));
+        uint64_t t[2];
+        t[0] = (_best(shell, pipeline, tail, sizeof(tail)) - base) / ROUNDS;
+        t[1] = (_best(shell, manual, tail, sizeof(tail)) - base) / ROUNDS;
+
+        //once more with the checksums of both files behind the copies, outside the timing
+        bool same = true;
+        FILE* scripts[2] = { pipeline, manual };
+        for(int k = 0; k < 2; k++)
+        {
+            fseek(scripts[k], timed[k], SEEK_SET);
+            fprintf(scripts[k], "cksum a\ncksum b\nexit -f\n");
+            fflush(scripts[k]);
+            _run(shell, scripts[k], tail, sizeof(tail));
+            same = same && _same(tail);
+        }
+
+        printf("%6zu KiB: pipeline %9.1f us %8.1f MB/s   manual %9.1f us %8.1f MB/s   %5.0fx%s\n", size >> 10,
+               t[0] / 1e3, size / (t[0] / 1e3), t[1] / 1e3, size / (t[1] / 1e3),
+               (double)t[1] / t[0], same ? "" : "   COPY FAILED");
+        fclose(setup);
+        fclose(pipeline);
+        fclose(manual);
+    }
+    return 0;
+}
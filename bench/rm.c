@@ -0,0 +1,75 @@
+//rm of subtrees of 1k to 1M files: how long rm itself takes, the bytes it leaves to the
+//reclaimer according to vfs_stats, and how long the reclaimer needs to free them
+//usage: bench/rm [largest subtree]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//a directory X below the root holding files 16 byte files, in folders of 1000
+void _subtree(vfs_session_t* s, size_t files)
+{
+    char name[32];
+    char text[16];
+    memset(text, 'x', sizeof(text));
+
+    vfs_cd(s, "/");
+    vfs_mkdir(s, "X");
+    for(size_t k = 0; k < files; k++)
+    {
+        if(k % 1000 == 0)
+        {
+            snprintf(name, sizeof(name), "/X/d%zu", k / 1000);
+            vfs_cd(s, "/X");
+            vfs_mkdir(s, name + 3);
+            vfs_cd(s, name);
+        }
+        snprintf(name, sizeof(name), "f%zu", k % 1000);
+        vfs_touch(s, name);
+        vfs_insert(s, name, (const uint8_t*)text, sizeof(text), false);
+    }
+    vfs_cd(s, "/");
+}
+
+int main(int argc, char** argv)
+{
+    size_t largest = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    for(size_t files = 1000; files <= largest; files *= 10)
+    {
+        vfs_t*         fs = vfs_create();
+        vfs_session_t* s  = vfs_session_open(fs);
+        _subtree(s, files);
+
+        uint64_t    t0     = _now_ns();
+        vfs_error_t status = vfs_rm(s, "X");
+        uint64_t    t1     = _now_ns();
+
+        vfs_stats_t stats;
+        vfs_stats(fs, &stats);
+        uint64_t pending = stats.reclaim_bytes;
+
+        //the reclaimer runs on its own, poll until it is done
+        struct timespec pause = { 0, 100000 };
+        while(stats.reclaim_bytes)
+        {
+            nanosleep(&pause, NULL);
+            vfs_stats(fs, &stats);
+        }
+        uint64_t t2 = _now_ns();
+
+        printf("%8zu files: rm %8.1f us (status %d)  pending after rm %9llu bytes  freed in background %8.1f ms (%llu nodes)\n",
+               files, (t1 - t0) / 1e3, status, (unsigned long long)pending, (t2 - t1) / 1e6,
+               (unsigned long long)stats.reclaimed);
+        vfs_destroy(fs);
+    }
+    return 0;
+}
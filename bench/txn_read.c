@@ -0,0 +1,240 @@
+//readers against a writer that keeps long transactions open: read throughput and the
+//longest single read with no writer, with the writer, and the cost of begin as the tree grows
+//usage: bench/txn_read [readers] [ms per phase] [ops per write transaction]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "vfs.h"
+
+#define DIRS  100
+#define FILES 100
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct
+{
+    vfs_t*       fs;
+    int          ops;       // per write transaction
+    int          span;      // files the transactions write and the readers read
+    _Atomic bool stop;
+} shared;
+
+typedef struct
+{
+    shared*  sh;
+    bool     snapshot;  // reads in read transactions of 256, else single checksums
+    uint64_t reads;
+    uint64_t worst_ns;
+    uint64_t torn;      // read transactions that saw two versions at once
+} reader;
+
+typedef struct
+{
+    shared*  sh;
+    uint64_t commits;
+    uint64_t conflicts;
+} writer;
+
+void _path(char* out, size_t size, int file)
+{
+    snprintf(out, size, "/d%d/f%d", file / FILES, file % FILES);
+}
+
+//every file of the tree holds the number of the transaction that wrote it last
+void* _read_loop(void* arg)
+{
+    reader*        rd = arg;
+    vfs_session_t* s  = vfs_session_open(rd->sh->fs);
+    char           path[32];
+    unsigned       seed = 1;
+
+    while(!atomic_load(&rd->sh->stop))
+    {
+        if(rd->snapshot)
+        {
+            uint64_t t0 = _now_ns();
+            vfs_begin_read(s);
+
+            uint64_t first = 0;
+            for(int k = 0; k < 256; k++)
+            {
+                const uint8_t* data;
+                size_t         len;
+                _path(path, sizeof(path), rand_r(&seed) % rd->sh->span);
+                if(vfs_read(s, path, &data, &len) != _OK || len != sizeof(uint64_t)) continue;
+
+                uint64_t stamp;
+                memcpy(&stamp, data, sizeof(stamp));
+                if(k == 0) first = stamp;
+                else if(stamp != first) rd->torn++;
+            }
+            vfs_commit(s);
+
+            uint64_t t1 = _now_ns();
+            if(t1 - t0 > rd->worst_ns) rd->worst_ns = t1 - t0;
+            rd->reads += 256;
+        }
+        else
+        {
+            uint32_t crc;
+            _path(path, sizeof(path), rand_r(&seed) % rd->sh->span);
+            uint64_t t0 = _now_ns();
+            vfs_checksum(s, path, &crc);
+            uint64_t t1 = _now_ns();
+            if(t1 - t0 > rd->worst_ns) rd->worst_ns = t1 - t0;
+            rd->reads++;
+        }
+    }
+    vfs_session_close(s);
+    return NULL;
+}
+
+//each transaction stamps the first span files with its own number, ops writes in all
+void* _write_loop(void* arg)
+{
+    writer*        wr = arg;
+    vfs_session_t* s  = vfs_session_open(wr->sh->fs);
+    char           path[32];
+
+    for(uint64_t stamp = 1; !atomic_load(&wr->sh->stop); stamp++)
+    {
+        vfs_begin(s);
+        for(int k = 0; k < wr->sh->ops; k++)
+        {
+            _path(path, sizeof(path), k % wr->sh->span);
+            vfs_insert(s, path, (const uint8_t*)&stamp, sizeof(stamp), false);
+        }
+        if(vfs_commit(s) == _OK) wr->commits++;
+        else                     wr->conflicts++;
+    }
+    vfs_session_close(s);
+    return NULL;
+}
+
+void _phase(shared* sh, int readers, int ms, bool snapshot, bool with_writer)
+{
+    pthread_t threads[64];
+    reader    rd[64];
+    writer    wr = { sh, 0, 0 };
+    pthread_t wt;
+
+    atomic_store(&sh->stop, false);
+    for(int k = 0; k < readers; k++)
+    {
+        rd[k] = (reader){ sh, snapshot, 0, 0, 0 };
+        pthread_create(&threads[k], NULL, _read_loop, &rd[k]);
+    }
+    if(with_writer) pthread_create(&wt, NULL, _write_loop, &wr);
+
+    uint64_t t0 = _now_ns();
+    struct timespec pause = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&pause, NULL);
+    atomic_store(&sh->stop, true);
+
+    uint64_t reads = 0, worst = 0, torn = 0;
+    for(int k = 0; k < readers; k++)
+    {
+        pthread_join(threads[k], NULL);
+        reads += rd[k].reads;
+        torn  += rd[k].torn;
+        if(rd[k].worst_ns > worst) worst = rd[k].worst_ns;
+    }
+    if(with_writer) pthread_join(wt, NULL);
+    double secs = (_now_ns() - t0) / 1e9;
+
+    printf("%-22s %-12s %10.0f reads/s  worst %8.1f us  torn %llu",
+           snapshot ? "read transactions" : "single checksums", with_writer ? "with writer" : "alone",
+           reads / secs, worst / 1e3, (unsigned long long)torn);
+    if(with_writer)
+    {
+        printf("  writer %6.1f txn/s (%llu conflicts)", wr.commits / secs, (unsigned long long)wr.conflicts);
+    }
+    printf("\n");
+}
+
+//a tree of about nodes nodes, then begin + one write + commit against it
+void _begin_cost(size_t nodes)
+{
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    char           name[32];
+    size_t         made = 1;
+
+    for(int dir = 0; made < nodes; dir++)
+    {
+        snprintf(name, sizeof(name), "d%d", dir);
+        vfs_cd(s, "/");
+        vfs_mkdir(s, name);
+        vfs_cd(s, name);
+        made++;
+        for(int k = 0; k < 999 && made < nodes; k++, made++)
+        {
+            snprintf(name, sizeof(name), "f%d", k);
+            vfs_touch(s, name);
+        }
+    }
+
+    int      rounds = 1000;
+    uint64_t t0     = _now_ns();
+    for(int k = 0; k < rounds; k++)
+    {
+        vfs_begin(s);
+        vfs_insert(s, "f0", (const uint8_t*)&k, sizeof(k), false);
+        vfs_commit(s);
+    }
+    uint64_t t1 = _now_ns();
+    printf("%8zu node tree: begin + write + commit %8.2f us\n", nodes, (t1 - t0) / 1e3 / rounds);
+    vfs_destroy(fs);
+}
+
+int main(int argc, char** argv)
+{
+    int readers = (argc > 1) ? atoi(argv[1]) : 4;
+    int ms      = (argc > 2) ? atoi(argv[2]) : 1000;
+    int ops     = (argc > 3) ? atoi(argv[3]) : 100000;
+    if(readers > 64) readers = 64;
+
+    shared sh;
+    sh.fs   = vfs_create();
+    sh.ops  = ops;
+    sh.span = (ops < DIRS * FILES) ? ops : DIRS * FILES;
+
+    //DIRS x FILES files of 8 bytes each
+    vfs_session_t* s     = vfs_session_open(sh.fs);
+    uint64_t       stamp = 0;
+    char           path[32];
+    for(int d = 0; d < DIRS; d++)
+    {
+        snprintf(path, sizeof(path), "d%d", d);
+        vfs_mkdir(s, path);
+        for(int f = 0; f < FILES; f++)
+        {
+            _path(path, sizeof(path), d * FILES + f);
+            vfs_touch(s, path);
+            vfs_insert(s, path, (const uint8_t*)&stamp, sizeof(stamp), false);
+        }
+    }
+    vfs_session_close(s);
+
+    printf("%d readers, %d ms per phase, %d writes per transaction\n", readers, ms, ops);
+    _phase(&sh, readers, ms, false, false);
+    _phase(&sh, readers, ms, false, true);
+    _phase(&sh, readers, ms, true, false);
+    _phase(&sh, readers, ms, true, true);
+    vfs_destroy(sh.fs);
+
+    size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    for(size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++)
+    {
+        _begin_cost(sizes[n]);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+//cost of publishing events: touch, insert and rm of a file in /w/d with no watches, with
+//watches that do not match, and with 1 to 1024 plain and recursive watches that all see every event
+//usage: bench/watch [rounds per run]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vfs.h"
+
+#define MAX_WATCHES 1024
+#define CHUNK       256   // rounds between drains, 3 events each fit a watch queue
+
+uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//rounds of touch + insert + rm in ns; the watches are drained untimed after every
+//chunk so that their queues never fill up and drop
+uint64_t _ops(vfs_session_t* s, int rounds, const int* wds, int count)
+{
+    vfs_event_t events[3 * CHUNK];
+    uint64_t    ns = 0;
+    for(int r = 0; r < rounds;)
+    {
+        uint64_t t0 = _now_ns();
+        for(int end = r + CHUNK; r < rounds && r < end; r++)
+        {
+            vfs_touch(s, "/w/d/f");
+            vfs_insert(s, "/w/d/f", (const uint8_t*)&r, sizeof(r), false);
+            vfs_rm(s, "/w/d/f");
+        }
+        ns += _now_ns() - t0;
+
+        for(int k = 0; k < count; k++)
+        {
+            size_t   got;
+            uint64_t lost;
+            vfs_events(s, wds[k], events, 3 * CHUNK, &got, &lost);
+        }
+    }
+    return ns;
+}
+
+//short runs without and with count watches on path, alternating, best of each;
+//the machine drifts, so every case gets a baseline of its own
+void _case(vfs_session_t* s, int rounds, const char* label, const char* path, bool recursive, int count)
+{
+    int      wds[MAX_WATCHES];
+    uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+    for(int run = 0; run < 15; run++)
+    {
+        uint64_t ns = _ops(s, rounds, wds, 0);
+        if(ns < best[0]) best[0] = ns;
+
+        for(int k = 0; k < count; k++)
+        {
+            vfs_watch(s, path, recursive, &wds[k]);
+        }
+        ns = _ops(s, rounds, wds, count);
+        if(ns < best[1]) best[1] = ns;
+        for(int k = 0; k < count; k++)
+        {
+            vfs_unwatch(s, wds[k]);
+        }
+    }
+
+    double without = (double)best[0] / rounds / 3;
+    double with    = (double)best[1] / rounds / 3;
+    printf("%-20s %4d watches: %8.1f ns per op, without %7.1f ns (%+8.1f ns)\n", label, count, with, without, with - without);
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 10000;
+
+    vfs_t*         fs = vfs_create();
+    vfs_session_t* s  = vfs_session_open(fs);
+    vfs_mkdir(s, "w");
+    vfs_mkdir(s, "other");
+    vfs_cd(s, "w");
+    vfs_mkdir(s, "d");
+    vfs_cd(s, "/");
+
+    printf("runs of %d x touch + insert + rm\n", rounds);
+    _case(s, rounds, "elsewhere (/other)", "/other", false, MAX_WATCHES);
+    int counts[] = { 1, 8, 64, 256, MAX_WATCHES };
+    for(size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+    {
+        _case(s, rounds, "parent (/w/d)", "/w/d", false, counts[k]);
+    }
+    for(size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+    {
+        _case(s, rounds, "recursive (/)", "/", true, counts[k]);
+    }
+
+    vfs_destroy(fs);
+    return 0;
+}
@@ -3,751 +3,822 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include "vfs.h"
 
-typedef enum 
-{
-    _OK,
-    _COMMAND_NOT_FOUND,
-    _INVALID_ARGUMENTS,
-    _NOT_A_DIRECTORY,
-    _NOT_FOUND,
-    _PERMISSION_DENIED,
-    _OBJECT_ALREADY_EXISTS,
-    _ILLEGAL_CHARACTER,
-    _TOO_LONG,
-    _NOT_A_FILE,
-    _WRONG_PASSWORD
-} error_t;
-
-//set up the file system
-typedef enum 
-{
-    _DIR,
-    _FILE
-} node_types;
-
-typedef enum 
-{
-    _CASUAL,
-    _SUPERUSER
-} users;
-
-typedef struct node
-{
-    char name[32];
-    struct node* sibling;
-    struct node* parent;
-    struct node* children;
-
-    node_types type;
-    size_t     size;
-    uint8_t*   data;
-    users      creator;
-} node;
-
-node* _root;
-node* _curr_dir;
-users _curr_usr = _CASUAL;
-char _curr_pass[128] = "helloworld";
-
-bool _is_allowed(node* nodeToAccess, users user)
-{
-    if(!nodeToAccess) return false;
-    if(nodeToAccess->creator == _CASUAL) return true;
-    if(nodeToAccess->creator == _SUPERUSER && user == _CASUAL) return false;
-    return true;
-}
-
-size_t _get_size(node* nd)
-{
-    if(!nd) return 0;
-    size_t NODESIZE = 0;
-    node* cur = nd->children;
-    
-    if(nd->data) NODESIZE += nd->size;
+vfs_t*         _vfs;
+vfs_session_t* _session;
+bool _interactive = true;
 
-    while(cur)
-    {
-        NODESIZE += _get_size(cur);
-        cur=cur->sibling;
-    }
+//command trace: a header followed by one record per executed command
+#define TRACE_MAGIC   "VFST"
+#define TRACE_VERSION 1
 
-    return NODESIZE;
-}
+//flags of a record
+#define TRACE_DECLINED 1   // rm was not confirmed, replay does not run it
+#define TRACE_MASKED   2   // the arguments are passwords, written as *
 
-node* _create_node(char* name, node_types type)
+typedef struct
 {
-    node *cur = malloc(sizeof(node));
-    strcpy(cur->name,name);
-    cur->type = type;
-    cur->parent = NULL;
-    cur->children = NULL;
-    cur->sibling = NULL;
-    cur->size = 0;
-    cur->data = NULL;
-    cur->creator = _CASUAL;
-    return cur;
-}
+    uint64_t time_ns;   // since the start of the recording
+    uint8_t  user;
+    uint8_t  flags;
+    int32_t  status;
+    uint16_t length;
+    char     command[2048];
+} trace_record;
+
+//how the line being run goes into the trace, when that is not the typed line
+char    _trace_line[2048];
+uint8_t _trace_flags;
 
 void init()
 {
-    _root = _create_node("/",_DIR);
-    _root->creator = _CASUAL;
-    _curr_dir      = _root;
+    _vfs     = vfs_create();
+    _session = vfs_session_open(_vfs);
+    if(!_vfs || !_session)
+    {
+        printf("Cannot create the file system!\n");
+        exit(_INVALID_ARGUMENTS);
+    }
 }
 
-void _add_child(node* parent, node* child)
+char* _parse_command_for_insert(char* command)
 {
-    child->parent = parent;
-    child->sibling = parent->children;
-    parent->children = child;
+    int   hashtag = strcspn(command,"#");
+    char* content = &command[hashtag+1];
+    content[strlen(content)] = '\0';
+    return content;
 }
 
-node* _find_child(char* name, node* parent)
+//commands
+void _mode_string(uint8_t mode, char* out)
 {
-    if(!parent) return NULL;
-    node* cur = parent->children;
-    while(cur)
+    const char* letters = "rwxrwx";
+    for(int b = 0; b < 6; b++)
     {
-        if(strcmp(cur->name, name)==0)
-            return cur;
-        cur= cur->sibling;
+        out[b] = (mode & (040 >> b)) ? letters[b] : '-';
     }
-    return NULL;
+    out[6] = '\0';
 }
 
-node* _node_from_path(char* path)
+//what a pipeline stage hands to the next one: a view straight into a file
+//of the tree, or a buffer that belongs to the pipeline
+typedef struct
 {
+    const uint8_t* data;
+    size_t         len;
+    uint8_t*       owned;   // NULL for a view
+    size_t         cap;
+} pipe_buffer;
 
-    if (path == NULL || path[0] == '\0')
-        return NULL;
-
-    if (strcmp(path,"/")==0) return _root;
-
-    char *save_pointer;
-    node* cur;
-
-    if(path[0] == '/')
-        cur = _root;
-    else
-        return NULL;
-    
-    char* path_copy = malloc(strlen(path)+1);
-    if(!path_copy) return NULL;
-    strcpy(path_copy,path);
-
-    char* del = "/";
-
-    char* token = strtok_r(path_copy,del,&save_pointer);
-    while(token)
+bool _pipe_append(pipe_buffer* pipe, const void* data, size_t len)
+{
+    if(pipe->len + len > pipe->cap)
     {
-        cur = _find_child(token,cur);
-        if(!cur)
+        size_t cap = pipe->cap ? pipe->cap : 4096;
+        while(cap < pipe->len + len)
         {
-            free(path_copy);
-            return NULL;
+            cap *= 2;
         }
-        token = strtok_r(NULL,del,&save_pointer);
+        uint8_t* grown = realloc(pipe->owned, cap);
+        if(!grown) return false;
+        pipe->owned = grown;
+        pipe->cap   = cap;
     }
-    
-    free(path_copy);
-    return cur; 
+    memcpy(pipe->owned + pipe->len, data, len);
+    pipe->len += len;
+    pipe->data = pipe->owned;
+    return true;
 }
 
-void _free_node(node* n)
+void _pipe_drop(pipe_buffer* pipe)
 {
-    if (!n) return;
-
-    node* child = n->children;
-    while (child)
-    {
-        node* next_sibling = child->sibling;
-        _free_node(child);
-        child = next_sibling;
-    }
-
-    if (n->data) free(n->data);
-
-    free(n);
+    free(pipe->owned);
+    memset(pipe, 0, sizeof(pipe_buffer));
 }
 
-char* _get_absolute_path(node* cwd)
+//block buffer for listings, so a large directory is not written line by line;
+//inside a pipeline it fills the buffer of the next stage instead of stdout
+typedef struct
 {
-    if (!cwd) return NULL;
+    char         data[65536];
+    size_t       used;
+    bool         sizes;
+    pipe_buffer* pipe;
+} out_buffer;
 
-    const int MAX_DEPTH = 512;
-    const node* stack[MAX_DEPTH];
-    int depth = 0;
+void _out_flush(out_buffer* out)
+{
+    if(out->pipe) _pipe_append(out->pipe, out->data, out->used);
+    else          fwrite(out->data, 1, out->used, stdout);
+    out->used = 0;
+}
 
-    const node* cur = cwd;
-    while (cur && depth < MAX_DEPTH) 
+void _out_printf(out_buffer* out, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t room = sizeof(out->data) - out->used;
+    int    len  = vsnprintf(out->data + out->used, room, format, args);
+    va_end(args);
+    if(len < 0) return;
+
+    if((size_t)len >= room)
     {
-        stack[depth++] = cur;
-        cur = cur->parent;
+        _out_flush(out);
+        va_start(args, format);
+        len = vsnprintf(out->data, sizeof(out->data), format, args);
+        va_end(args);
+        if(len < 0) return;
     }
+    out->used += (size_t)len;
+}
 
-    if (depth >= MAX_DEPTH) return NULL;
+int _print_entry(const vfs_entry_t* entry, void* ctx)
+{
+    out_buffer* out = ctx;
+    char* mode = (entry->owner == _CASUAL) ? "Casual" : "Superuser";
+    char  bits[7];
+    _mode_string(entry->mode, bits);
+    char  kind = (entry->type == _DIR) ? '>' : '-';
 
-    int total_len = 1; 
-    for (int i = depth - 1; i >= 0; i--) 
+    if(out->sizes)
     {
-        total_len += strlen(stack[i]->name) + 1; 
+        _out_printf(out, "%c%s    (Size:%zu) Mode:%s %s\n",kind,entry->name,entry->size,mode,bits);
     }
-
-    char* path = malloc(total_len + 1);
-    if (!path) return NULL;
-
-    path[0] = '\0';
-
-    for (int i = depth - 1; i >= 0; i--) 
+    else
     {
-        if(strcmp(stack[i]->name,"/") == 0) continue;
-        
-        strcat(path, "/");
-    
-        if (i != depth - 1 || strcmp(stack[i]->name, "/") != 0)
-            strcat(path, stack[i]->name);
+        _out_printf(out, "%c%s    Mode:%s %s\n",kind,entry->name,mode,bits);
     }
+    return 0;
+}
 
-    if (strcmp(path, "") == 0) strcpy(path, "/");
+//how results leave the shell: text for people, or one framed record per command for programs
+typedef enum
+{
+    _OUT_TEXT,
+    _OUT_BINARY,
+    _OUT_JSON
+} output_modes;
 
-    return path;
-}
+//typed fields of a record; entries, events, corrupted and diff repeat
+typedef enum
+{
+    _FIELD_ENTRY = 1,
+    _FIELD_DATA,
+    _FIELD_CURSOR,
+    _FIELD_FD,
+    _FIELD_WD,
+    _FIELD_EVENT,
+    _FIELD_LOST,
+    _FIELD_USER,
+    _FIELD_CRC,
+    _FIELD_CORRUPTED,
+    _FIELD_CHECKED,
+    _FIELD_DIFF,
+    _FIELD_RECLAIM_BYTES,
+    _FIELD_RECLAIMED
+} record_fields;
+
+const char* _field_names[] = { "", "entries", "data", "cursor", "fd", "wd", "events", "lost", "user",
+                               "crc", "corrupted", "checked", "diff", "reclaim_bytes", "reclaimed" };
+
+const char* _error_names[] = { "_OK", "_COMMAND_NOT_FOUND", "_INVALID_ARGUMENTS", "_NOT_A_DIRECTORY",
+                               "_NOT_FOUND", "_PERMISSION_DENIED", "_OBJECT_ALREADY_EXISTS",
+                               "_ILLEGAL_CHARACTER", "_TOO_LONG", "_NOT_A_FILE", "_WRONG_PASSWORD",
+                               "_NOT_IN_TRANSACTION", "_ALREADY_IN_TRANSACTION", "_CONFLICT", "_CORRUPTED",
+                               "_IN_USE" };
+
+const char* _event_names[] = { "created", "modified", "deleted", "moved" };
+
+output_modes _output = _OUT_TEXT;
+
+//every record is built in one buffer, which is written out in one go
+//before the shell waits for the next command
+typedef struct
+{
+    pipe_buffer   buf;
+    size_t        start;        // where the open record begins
+    record_fields open_array;   // json array that is still open, 0 if none
+    bool          first;        // no json field in the open record yet
+} frame_writer;
 
-char* _parse_command_for_insert(char* command)
+frame_writer _frame;
+
+bool _framed()
 {
-    int   hashtag = strcspn(command,"#");
-    char* content = &command[hashtag+1];
-    content[strlen(content)] = '\0';
-    return content;
+    return _output != _OUT_TEXT;
 }
 
-//commands
-int _clear()
+//messages meant for a person, framed output leaves them out
+void _say(const char* format, ...)
 {
-    printf("\x1b[2J\x1b[H");
-    return _OK;
+    if(_framed()) return;
+
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
 }
 
-int _ls(node* cwd)
+void _frame_put(const void* data, size_t len)
 {
-    node* cur = cwd->children;
-    char* mode;
+    _pipe_append(&_frame.buf, data, len);
+}
 
-    while(cur)
+//formats into a small buffer, or into one of the size vsnprintf asked for if that is too short
+void _frame_printf(const char* format, ...)
+{
+    char    small[256];
+    va_list args, again;
+    va_start(args, format);
+    va_copy(again, args);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+
+    if(len > 0 && (size_t)len < sizeof(small))
     {
-        if(cur->creator==_CASUAL)
-        {
-            mode = "Casual";
-        }
-        else
-        {
-            mode = "Superuser";
-        }
-
-        size_t size = _get_size(cur);
-
-        if(cur->type == _DIR)
-        {
-            printf(">%s    (Size:%zu) Mode:%s\n",cur->name,size,mode);
-        }
-        else
+        _frame_put(small, (size_t)len);
+    }
+    else if(len > 0)
+    {
+        char* big = malloc((size_t)len + 1);
+        if(big)
         {
-            printf("-%s    (Size:%zu) Mode:%s\n",cur->name,size,mode);
+            vsnprintf(big, (size_t)len + 1, format, again);
+            _frame_put(big, (size_t)len);
+            free(big);
         }
-        cur = cur->sibling;
     }
-    return _OK;
+    va_end(again);
 }
 
-int _touch(node* cwd, char* name,users currentuser)
+//json strings are bytes: quotes, backslashes, control characters and bytes above 0x7f are escaped
+void _json_string(const uint8_t* data, size_t len)
 {
-    if(strlen(name) >= 32)
-    {
-        return _TOO_LONG;
-    }
-
-    node* cur =cwd->children;
-    if (name[0] == '\0' || strcmp(name,".")==0 || strcmp(name,"..")==0) 
-        return _ILLEGAL_CHARACTER;
-    
-    for (int i = 0; name[i]; i++) 
+    _frame_put("\"", 1);
+    size_t plain = 0;
+    for(size_t k = 0; k < len; k++)
     {
-        char c = name[i];
-        if (!((c >= 'a' && c <= 'z') ||
-              (c >= 'A' && c <= 'Z') ||
-              (c >= '0' && c <= '9') ||
-               c == '_' || c == '-'  || c == '.'))
-            {
-                return _ILLEGAL_CHARACTER;
-            }
-    }
-    
-    while(cur)
-    {
-        if(strcmp(cur->name,name)==0) return _OBJECT_ALREADY_EXISTS;
+        uint8_t c = data[k];
+        if(c >= 0x20 && c < 0x80 && c != '"' && c != '\\') continue;
 
-        cur = cur->sibling;
+        _frame_put(data + plain, k - plain);
+        if(c == '"' || c == '\\') _frame_printf("\\%c", c);
+        else                      _frame_printf("\\u%04x", c);
+        plain = k + 1;
     }
-
-    node* new_file = _create_node(name, _FILE);
-    if(_is_allowed(cwd,_curr_usr) == false) 
-    {
-        _free_node(new_file);
-        return _PERMISSION_DENIED;
-        
-    }
-    new_file->creator = currentuser;
-    _add_child(cwd,new_file);
-    return _OK;
+    _frame_put(data + plain, len - plain);
+    _frame_put("\"", 1);
 }
 
-int _move(char* source, char* destination, node* cwd)
+void _json_field(record_fields field, bool array)
 {
-    if(!source || !destination) return _INVALID_ARGUMENTS;
-
-    node* SourceNode = strchr(source,'/') ? _node_from_path(source) : _find_child(source,cwd);
-    node* TargetDestination = strchr(destination,'/') ? _node_from_path(destination) : _find_child(destination,cwd);
-
-    if(!SourceNode) return _NOT_FOUND;
-    if(!TargetDestination) return _NOT_FOUND;
-    if(TargetDestination->type != _DIR) return _NOT_A_DIRECTORY;
-
-    node* oldParent = SourceNode->parent;
-    if(!oldParent) return _INVALID_ARGUMENTS; 
-
-    if(oldParent->children == SourceNode) 
+    if(array && _frame.open_array == field)
     {
-        oldParent->children = SourceNode->sibling;
+        _frame_put(",", 1);
+        return;
     }
-    else 
+    if(_frame.open_array)
     {
-        node* cur = oldParent->children;
-        while(cur && cur->sibling != SourceNode)
-        {
-            cur = cur->sibling;
-        }
-        if(!cur) return _NOT_FOUND;
-        cur->sibling = SourceNode->sibling;
+        _frame_put("]", 1);
+        _frame.open_array = 0;
     }
+    if(!_frame.first) _frame_put(",", 1);
+    _frame.first = false;
 
-    node* childNewParent = TargetDestination->children;
-    while(childNewParent)
+    _frame_printf("\"%s\":", _field_names[field]);
+    if(array)
     {
-        if(strcmp(childNewParent->name,SourceNode->name)==0)
-        {
-            printf("There is a file there with the same name!\n");
-            return _OBJECT_ALREADY_EXISTS;
-        }
-        
-        childNewParent = childNewParent->sibling;
+        _frame_put("[", 1);
+        _frame.open_array = field;
     }
-
-    SourceNode->parent = TargetDestination;
-    SourceNode->sibling = TargetDestination->children;
-    TargetDestination->children = SourceNode;
-
-    return _OK;
 }
 
-int _insert(char* content, char* name, node* cwd,char* option,users current)
+void _frame_flush()
 {
-    if(!name)    return _INVALID_ARGUMENTS;
-    if(!content) return _INVALID_ARGUMENTS;
-    if(!option)  return _INVALID_ARGUMENTS;
+    if(_frame.buf.len) fwrite(_frame.buf.owned, 1, _frame.buf.len, stdout);
+    _frame.buf.len = 0;
+    fflush(stdout);
+}
 
-    node* file = _find_child(name,cwd);
-    if(!file)    return _NOT_FOUND;
+//binary: u64 length of the rest, i32 vfs_error_t, then the fields; json: one object per line
+void _frame_begin()
+{
+    if(!_framed()) return;
 
-    if(!_is_allowed(file,current))
+    _frame.start      = _frame.buf.len;
+    _frame.open_array = 0;
+    _frame.first      = true;
+    if(_output == _OUT_BINARY)
     {
-        return _PERMISSION_DENIED;
+        uint8_t header[12] = {0};
+        _frame_put(header, sizeof(header));
     }
-
-    size_t old_size = file->data ? _get_size(file) : 0;
-
-    if(strlen(content) > 1023) return _TOO_LONG;
-    if(file->type != _FILE) return _NOT_A_FILE;
-    
-    //overwrite
-    if(strcmp(option,">")==0)
+    else
     {
-        free(file->data);
-        file->data = malloc(strlen(content) + 1);
-        strcpy((char*) file->data,content);
-        file->size = strlen(content);
-        size_t delta = _get_size(file) - old_size;
-
-        node* cur = file->parent;
-        while(cur)
-        {
-            cur->size += delta;
-            cur = cur->parent;
-        }
-        
+        _frame_put("{", 1);
     }
-    //append
-    else if(strcmp(option, ">>") == 0)
-    {
-        size_t content_len = strlen(content);
-        size_t new_size = old_size + content_len;
-
-        char* new_data = malloc(new_size + 1);
-        if (!new_data) return _INVALID_ARGUMENTS;
-
-        if (file->data)
-            memcpy(new_data, file->data, old_size);
-
-        memcpy(new_data + old_size, content, content_len);
-        new_data[new_size] = '\0';
-
-        free(file->data);
-        file->data = (uint8_t*)new_data;
-        file->size = new_size;
+}
 
-        size_t delta = new_size - old_size;
+void _frame_end(int status)
+{
+    if(!_framed()) return;
 
-        node* cur = file->parent;
-        while (cur)
-        {
-            cur->size += delta;
-            cur = cur->parent;
-        }
+    if(_output == _OUT_BINARY)
+    {
+        uint64_t length = _frame.buf.len - _frame.start - sizeof(uint64_t);
+        int32_t  code   = status;
+        memcpy(_frame.buf.owned + _frame.start, &length, sizeof(length));
+        memcpy(_frame.buf.owned + _frame.start + sizeof(length), &code, sizeof(code));
     }
     else
     {
-        return _INVALID_ARGUMENTS;
+        if(_frame.open_array) _frame_put("]", 1);
+        if(!_frame.first) _frame_put(",", 1);
+        const char* name = (status >= 0 && status <= _IN_USE) ? _error_names[status] : "";
+        _frame_printf("\"status\":%d,\"error\":\"%s\"}\n", status, name);
     }
 
-    return _OK;
+    //a long batch of commands does not pile up in memory
+    if(_frame.buf.len >= (1u << 20)) _frame_flush();
 }
 
-int _print(node* cwd, char* name, users current)
+void _emit_number(record_fields field, uint64_t value)
 {
-    if(!name) return _INVALID_ARGUMENTS;
-    node* file = _find_child(name,cwd);
-    if(!file) return _NOT_FOUND;
-
-    if(!_is_allowed(file,current))
+    if(_output == _OUT_BINARY)
     {
-        return _PERMISSION_DENIED;
+        uint8_t tag = field;
+        _frame_put(&tag, 1);
+        _frame_put(&value, sizeof(value));
+        return;
     }
-
-    if(file->type != _FILE) return _NOT_A_FILE;
-
-    if(file->data)
-        printf("%s", file->data);
-    return _OK;
+    _json_field(field, false);
+    _frame_printf("%llu", (unsigned long long)value);
 }
 
-int _help()
+void _emit_data(const uint8_t* data, size_t len)
 {
-    printf("ls     - List folders and files\n");
-    printf("move   - Move folders/files around\n");
-    printf("mkdir  - Create a folder\n");
-    printf("cd     - Change current folder\n");
-    printf("change - Change superuser password\n");
-    printf("rm     - Remove item");
-    printf("uprint - Print the current user status (Superuser/Casual)\n");
-    printf("switch - Switch between casual user and superuser\n");
-    printf("touch  - Create a file\n");
-    printf("clear  - Clear the screen\n");
-    printf("exit   - Exit the program\n");
-    printf("insert - Insert data into a file\n");
-    printf("print! - Print the contents of a file\n");
-    printf("help   - Show this menu\n");
-
-    return _OK;
+    if(_output == _OUT_BINARY)
+    {
+        uint8_t  tag    = _FIELD_DATA;
+        uint64_t length = len;
+        _frame_put(&tag, 1);
+        _frame_put(&length, sizeof(length));
+        _frame_put(data, len);
+        return;
+    }
+    _json_field(_FIELD_DATA, false);
+    _json_string(data, len);
 }
 
-int _mkdir(node* cwd, char* name, users current)
+//a path, with the kind of difference for diff records
+void _emit_path(record_fields field, event_types type, const char* path)
 {
-    if(strlen(name) >= 32)
+    size_t len = strlen(path);
+    if(_output == _OUT_BINARY)
     {
-        return _TOO_LONG;
+        uint8_t  tag    = field;
+        uint8_t  kind   = type;
+        uint64_t length = len;
+        _frame_put(&tag, 1);
+        if(field == _FIELD_DIFF) _frame_put(&kind, 1);
+        _frame_put(&length, sizeof(length));
+        _frame_put(path, len);
+        return;
     }
-
-    node* cur = cwd->children;
-
-    if (name[0] == '\0' || strcmp(name,".")==0 || strcmp(name,"..")==0) 
-    return _ILLEGAL_CHARACTER;
-    while(cur)
+    _json_field(field, true);
+    if(field == _FIELD_DIFF)
     {
-        if(strcmp(cur->name,name)==0) return _OBJECT_ALREADY_EXISTS;
-
-        cur = cur->sibling;
+        _frame_printf("{\"type\":\"%s\",\"path\":", _event_names[type]);
+        _json_string((const uint8_t*)path, len);
+        _frame_put("}", 1);
+        return;
     }
+    _json_string((const uint8_t*)path, len);
+}
 
-    for (int i = 0; name[i]; i++) 
+void _emit_event(const vfs_event_t* event)
+{
+    if(_output == _OUT_BINARY)
     {
-        char c = name[i];
-        if (!((c >= 'a' && c <= 'z') ||
-              (c >= 'A' && c <= 'Z') ||
-              (c >= '0' && c <= '9') ||
-               c == '_' || c == '-'  || c == '.'))
-            {
-                return _ILLEGAL_CHARACTER;
-            }
+        uint8_t tag  = _FIELD_EVENT;
+        uint8_t type = event->type;
+        _frame_put(&tag, 1);
+        _frame_put(&type, 1);
+        _frame_put(&event->node, sizeof(event->node));
+        return;
     }
-    
-    node* new_dir = _create_node(name, _DIR);
-    if(_is_allowed(cwd,_curr_usr) == false) 
+    _json_field(_FIELD_EVENT, true);
+    _frame_printf("{\"type\":\"%s\",\"node\":%llu}", _event_names[event->type], (unsigned long long)event->node);
+}
+
+int _emit_entry(const vfs_entry_t* entry, void* ctx)
+{
+    (void)ctx;
+    if(_output == _OUT_BINARY)
     {
-        _free_node(new_dir);
-        return _PERMISSION_DENIED;
+        uint8_t  record[1 + 8 + 1 + 8 + 1 + 1 + 1 + 32];
+        uint8_t* at   = record;
+        uint64_t size = entry->size;
+        uint8_t  len  = (uint8_t)strlen(entry->name);
+
+        *at++ = _FIELD_ENTRY;
+        memcpy(at, &entry->id, 8);
+        at += 8;
+        *at++ = (uint8_t)entry->type;
+        memcpy(at, &size, 8);
+        at += 8;
+        *at++ = (uint8_t)entry->owner;
+        *at++ = entry->mode;
+        *at++ = len;
+        memcpy(at, entry->name, len);
+        _frame_put(record, (at - record) + len);
+        return 0;
     }
-    if(cwd->creator == _SUPERUSER) new_dir->creator = _SUPERUSER;
-    
-    new_dir->creator = current;
-    _add_child(cwd,new_dir);
-    
+    _json_field(_FIELD_ENTRY, true);
+    _frame_put("{\"name\":", 8);
+    _json_string((const uint8_t*)entry->name, strlen(entry->name));
+    _frame_printf(",\"id\":%llu,\"type\":\"%s\",\"size\":%zu,\"owner\":\"%s\",\"mode\":%u}",
+                  (unsigned long long)entry->id, (entry->type == _DIR) ? "dir" : "file", entry->size,
+                  (entry->owner == _CASUAL) ? "casual" : "superuser", entry->mode);
+    return 0;
+}
 
+int _clear()
+{
+    _say("\x1b[2J\x1b[H");
     return _OK;
 }
 
-int _rm_by_path(char* path,users current)
+//parse a number argument, "-" stands for the current offset of a handle
+bool _parse_size(char* arg, size_t* out)
 {
-    if (!path || strcmp(path, "/") == 0) 
+    if(strcmp(arg, "-") == 0)
     {
-        printf("Cannot delete root!\n");
-        return _INVALID_ARGUMENTS;
+        *out = VFS_CURRENT;
+        return true;
     }
 
-    char* parent_path = strdup(path);
-    if (!parent_path) return _INVALID_ARGUMENTS;
+    char* end;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if(arg[0] == '\0' || arg[0] == '-' || *end != '\0') return false;
+    *out = (size_t)value;
+    return true;
+}
 
-    char* node_name = strrchr(parent_path, '/');
-    if (!node_name) 
-    {
-        free(parent_path);
-        return _NOT_FOUND;
-    }
+//parse a handle or watch number, anything but a plain non-negative int is refused
+bool _parse_fd(char* arg, int* out)
+{
+    char* end;
+    long value = strtol(arg, &end, 10);
+    if(arg[0] == '\0' || arg[0] == '-' || *end != '\0' || value > INT_MAX) return false;
+    *out = (int)value;
+    return true;
+}
 
-    *node_name = '\0';
-    node_name++;
+int _open(char* path, char* mode)
+{
+    open_modes m;
+    if(!mode || strcmp(mode, "r") == 0) m = _READ;
+    else if(strcmp(mode, "w") == 0)     m = _WRITE;
+    else if(strcmp(mode, "a") == 0)     m = _APPEND;
+    else return _INVALID_ARGUMENTS;
+
+    int fd;
+    int status = vfs_open(_session, path, m, &fd);
+    if(status == _OK && _framed()) _emit_number(_FIELD_FD, (uint64_t)fd);
+    else if(status == _OK)          printf("%d\n", fd);
+    return status;
+}
 
-    node* parent = (strlen(parent_path) == 0) ? _root : _node_from_path(parent_path);
-    if (!parent) 
-    {
-        free(parent_path);
-        return _NOT_FOUND;
-    }
+int _read(char* fd, char* offset, char* len)
+{
+    int    handle;
+    size_t off, count;
+    if(!_parse_fd(fd, &handle) || !_parse_size(offset, &off) || !_parse_size(len, &count) || count == VFS_CURRENT)
+        return _INVALID_ARGUMENTS;
 
-    node* prev = NULL;
-    node* cur = parent->children;
-    while (cur) 
-    {
-        if (strcmp(cur->name, node_name) == 0) 
-        {
+    const uint8_t* data;
+    size_t got;
+    int status = vfs_pread(_session, handle, off, count, &data, &got);
+    if(status == _OK && _framed()) _emit_data(data, got);
+    else if(status == _OK && got)   fwrite(data, 1, got, stdout);
+    return status;
+}
 
-            if(!_is_allowed(cur,current))
-            {
-                free(parent_path);
-                return _PERMISSION_DENIED;
-            }
-            if (cur == _curr_dir) 
-            {
-                printf("Cannot delete current working directory!\n");
-                free(parent_path);
-                return _INVALID_ARGUMENTS;
-            }
+int _write(char* fd, char* offset, char* command)
+{
+    int    handle;
+    size_t off;
+    if(!_parse_fd(fd, &handle) || !_parse_size(offset, &off)) return _INVALID_ARGUMENTS;
 
-            if (prev)
-                prev->sibling = cur->sibling;
-            else
-                parent->children = cur->sibling;
-    
-            size_t delta = _get_size(cur);
-            node* par = parent;
-            while(par)
-            {
-                par->size -= delta;
-                par = par->parent;
-            }
-            
-            _free_node(cur);
-            free(parent_path);
-            return _OK;
-        }
-        prev = cur;
-        cur = cur->sibling;
-    }
+    command[strcspn(command, "\n")] = '\0';
+    char* content = _parse_command_for_insert(command);
+    return vfs_pwrite(_session, handle, off, (const uint8_t*)content, strlen(content));
+}
 
-    free(parent_path);
-    return _NOT_FOUND;
+int _seek(char* fd, char* offset)
+{
+    int    handle;
+    size_t off;
+    if(!_parse_fd(fd, &handle) || !_parse_size(offset, &off)) return _INVALID_ARGUMENTS;
+    return vfs_seek(_session, handle, off);
 }
 
-int _rm(node* cwd, char* name,int conf,users current)
+int _close(char* fd)
 {
-    if(!conf)
-    {
-        char choice[10];
-        printf("Are you sure you want to delete %s? (yes/no): ", name);
-        if (!fgets(choice, sizeof(choice), stdin)) return _INVALID_ARGUMENTS;
+    int handle;
+    if(!_parse_fd(fd, &handle)) return _INVALID_ARGUMENTS;
+    return vfs_close(_session, handle);
+}
 
-    
-        choice[strcspn(choice, "\n")] = '\0';
+int _watch(char* path, char* flag)
+{
+    if(flag && strcmp(flag, "-r") != 0) return _INVALID_ARGUMENTS;
 
-    
-        int c;
-        while ((c = getchar()) != '\n' && c != EOF);
+    int wd;
+    int status = vfs_watch(_session, path, flag != NULL, &wd);
+    if(status == _OK && _framed()) _emit_number(_FIELD_WD, (uint64_t)wd);
+    else if(status == _OK)          printf("%d\n", wd);
+    return status;
+}
 
-        if (strcmp(choice, "no") == 0) return _OK;
-        if (strcmp(choice, "yes") != 0) return _INVALID_ARGUMENTS;
-    }
+int _events(char* wd)
+{
+    vfs_event_t events[64];
+    size_t   got;
+    uint64_t lost, total_lost = 0;
+    int      watch;
+    if(!_parse_fd(wd, &watch)) return _INVALID_ARGUMENTS;
 
-    
-    if (strchr(name, '/')) 
+    do
     {
-        return _rm_by_path(name,current);
-    }
+        int status = vfs_events(_session, watch, events, 64, &got, &lost);
+        if(status != _OK) return status;
 
-    
-    node* prev = NULL;
-    node* cur = cwd->children;
-    while (cur) 
-    {
-        if (strcmp(cur->name, name) == 0) 
+        total_lost += lost;
+        for(size_t k = 0; k < got; k++)
         {
-            if(!_is_allowed(cur,current))
-            {
-                return _PERMISSION_DENIED;
-            }
-            if (cur == _curr_dir) 
-            {
-                printf("Cannot delete current working directory!\n");
-                return _INVALID_ARGUMENTS;
-            }
+            if(_framed()) _emit_event(&events[k]);
+            else          printf("%s %llu\n", _event_names[events[k].type], (unsigned long long)events[k].node);
+        }
+    } while(got == 64);
 
-            if (prev)
-                prev->sibling = cur->sibling;
-            else
-                cwd->children = cur->sibling;
+    if(_framed())        _emit_number(_FIELD_LOST, total_lost);
+    else if(total_lost) printf("%llu events were lost, the watch queue was full\n", (unsigned long long)total_lost);
+    return _OK;
+}
 
-            size_t delta = _get_size(cur);
-            _free_node(cur);
-            
-            if(cwd == _root) return _OK;
+int _chmod(char* mode, char* path)
+{
+    char* end;
+    long bits = strtol(mode, &end, 8);
+    if(*end != '\0' || bits < 0 || bits > VFS_MODE_MASK) return _INVALID_ARGUMENTS;
 
-            node* par = cwd;
-            while(par)
-            {
-                par->size -= delta;
-                par = par->parent;
-            }
-            
-            return _OK;
-        }
-        prev = cur;
-        cur = cur->sibling;
-    }
+    return vfs_chmod(_session, path, (uint8_t)bits);
+}
 
-    return _NOT_FOUND;
+int _chown(char* owner, char* path)
+{
+    if(strcmp(owner, "casual") == 0)    return vfs_chown(_session, path, _CASUAL);
+    if(strcmp(owner, "superuser") == 0) return vfs_chown(_session, path, _SUPERUSER);
+    return _INVALID_ARGUMENTS;
 }
 
-int _cd(node* cwd, char* name)
+int _report_corrupted(const char* path, void* ctx)
 {
+    (void)ctx;
+    if(_framed()) _emit_path(_FIELD_CORRUPTED, _MODIFIED, path);
+    else          printf("corrupted: %s\n", path);
+    return 0;
+}
 
-    node* cur = cwd->children;
-    
-    if(strchr(name,'/'))
-    {
-        node* target=_node_from_path(name);
-        if(!target) return _NOT_FOUND;
-        if(target->type != _DIR) return _NOT_A_DIRECTORY;
-        
-        if(!_is_allowed(target,_curr_usr)) return _PERMISSION_DENIED;
-        _curr_dir =target;
-        return _OK;
-    }
+int _verify(char* path)
+{
+    size_t checked = 0;
+    int status = vfs_verify(_session, path, _report_corrupted, NULL, &checked);
+    if(status != _OK && status != _CORRUPTED) return status;
+
+    if(_framed()) _emit_number(_FIELD_CHECKED, checked);
+    else          printf("%zu files verified\n", checked);
+    return status;
+}
+
+int _cksum(char* path)
+{
+    uint32_t crc;
+    int status = vfs_checksum(_session, path, &crc);
+    if(status == _OK && _framed()) _emit_number(_FIELD_CRC, crc);
+    else if(status == _OK)          printf("%08x %s\n", crc, path);
+    return status;
+}
+
+int _print_difference(event_types type, const char* path, void* ctx)
+{
+    (void)ctx;
+    char mark = (type == _CREATED) ? '+' : (type == _DELETED) ? '-' : '~';
+    if(_framed()) _emit_path(_FIELD_DIFF, type, path);
+    else          printf("%c %s\n", mark, path);
+    return 0;
+}
+
+int _diff(char* a, char* b)
+{
+    return vfs_diff(_session, a, b, _print_difference, NULL);
+}
 
-    if(strcmp(name,"..")==0)
+int _ls(char** splt, int i, pipe_buffer* pipe)
+{
+    size_t   limit  = 0;
+    uint64_t cursor = 0;
+    bool     sizes  = true;
+
+    for(int a = 1; a < i; a++)
     {
-        if(strcmp(_curr_dir->name,"/")==0)
+        char* end;
+        if(strcmp(splt[a], "--no-size") == 0)
+        {
+            sizes = false;
+        }
+        else if(strcmp(splt[a], "--limit") == 0 && a + 1 < i)
         {
-            return _OK;
+            limit = strtoull(splt[++a], &end, 10);
+            if(*end != '\0' || limit == 0) return _INVALID_ARGUMENTS;
+        }
+        else if(strcmp(splt[a], "--cursor") == 0 && a + 1 < i)
+        {
+            cursor = strtoull(splt[++a], &end, 10);
+            if(*end != '\0') return _INVALID_ARGUMENTS;
         }
         else
         {
-            _curr_dir = _curr_dir->parent;
-            return _OK;
+            _say("Bad Usage! The right way is: ls [--limit N] [--cursor C] [--no-size]\n");
+            return _INVALID_ARGUMENTS;
         }
     }
 
-    while(cur)
+    out_buffer* out = malloc(sizeof(out_buffer));
+    if(!out) return _INVALID_ARGUMENTS;
+    out->used  = 0;
+    out->sizes = sizes;
+    out->pipe  = pipe;
+
+    //records carry the entries themselves, a pipeline still gets text
+    uint64_t next;
+    if(_framed() && !pipe)
     {
-        if(strcmp(cur->name,name)==0)
-        {
-            if(cur->type != _DIR)
-            {
-                return _NOT_A_DIRECTORY;
-            }
-            if(!_is_allowed(cur,_curr_usr)) return _PERMISSION_DENIED;
-            _curr_dir = cur;
-            return _OK;
-        }
-        cur=cur->sibling;
+        free(out);
+        int status = vfs_ls_page(_session, cursor, limit, sizes, _emit_entry, NULL, &next);
+        if(status == _OK && next) _emit_number(_FIELD_CURSOR, next);
+        return status;
     }
 
-    return _NOT_FOUND;
+    int status = vfs_ls_page(_session, cursor, limit, sizes, _print_entry, out, &next);
+    if(status == _OK && next) _out_printf(out, "cursor: %llu\n", (unsigned long long)next);
+    _out_flush(out);
+    free(out);
+    return status;
 }
 
-int _print_user()
+int _print(char* name)
 {
-    (_curr_usr == _CASUAL) ? printf("Casual\n") : printf("Superuser\n");
-    return _OK;
+    const uint8_t* data;
+    size_t len;
+
+    int status = vfs_read(_session, name, &data, &len);
+    if(status == _OK && _framed()) _emit_data(data, len);
+    else if(status == _OK && len)   fwrite(data, 1, len, stdout);
+    return status;
 }
 
-int _switch_users(users currentUser,char* password)
+int _rm(char* name,int conf)
 {
-    if(currentUser == _CASUAL)
+    if(!conf && _interactive)
     {
-        if(!password) return _INVALID_ARGUMENTS;
-        if(strcmp(password,_curr_pass)==0)
-        {
-            _curr_usr = _SUPERUSER;
-            return _OK;
-        }
-        else
+        char choice[10];
+        printf("Are you sure you want to delete %s? (yes/no): ", name);
+
+        //only the outcome of the question goes into the trace, replay cannot ask
+        _trace_flags |= TRACE_DECLINED;
+        if (!fgets(choice, sizeof(choice), stdin)) return _INVALID_ARGUMENTS;
+
+        //only an overlong answer leaves the rest of its line behind
+        if (!strchr(choice, '\n'))
         {
-            return _WRONG_PASSWORD;
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF);
         }
+        choice[strcspn(choice, "\n")] = '\0';
+
+        if (strcmp(choice, "no") == 0) return _OK;
+        if (strcmp(choice, "yes") != 0) return _INVALID_ARGUMENTS;
+
+        _trace_flags &= ~TRACE_DECLINED;
+        snprintf(_trace_line, sizeof(_trace_line), "rm -f %s\n", name);
     }
-    else
+
+    if (strcmp(name, "/") == 0)
     {
-        _curr_usr = _CASUAL;
-        return _OK;
+        _say("Cannot delete root!\n");
+        return _INVALID_ARGUMENTS;
     }
+
+    return vfs_rm(_session, name);
 }
 
-int _change_pass(users currentUser, char* newPassword)
+int _help()
 {
-    if(currentUser == _CASUAL) return _PERMISSION_DENIED;
+    _say("ls     - List folders and files ([--limit N] [--cursor C] [--no-size])\n");
+    _say("move   - Move folders/files around\n");
+    _say("mkdir  - Create a folder\n");
+    _say("cd     - Change current folder\n");
+    _say("change - Change superuser password\n");
+    _say("rm     - Remove item");
+    _say("uprint - Print the current user status (Superuser/Casual)\n");
+    _say("switch - Switch between casual user and superuser\n");
+    _say("touch  - Create a file\n");
+    _say("chmod  - Set the owner/other rwx bits of an item, e.g. chmod 75 dir\n");
+    _say("chown  - Give an item to casual or superuser\n");
+    _say("clear  - Clear the screen\n");
+    _say("exit   - Exit the program (-f: don't wait for removed items to be freed)\n");
+    _say("stats  - Print background reclamation counters\n");
+    _say("insert - Insert data into a file\n");
+    _say("print! - Print the contents of a file\n");
+    _say("grep   - Keep the lines containing a text, e.g. ls | grep txt\n");
+    _say("|      - Pass the output of print!/ls/grep on, e.g. print! a | insert >> b\n");
+    _say(">, >>  - Write the output of print!/ls/grep into a file, e.g. print! a > /dir/b\n");
+    _say("open   - Open a file for r/w/a and print its handle\n");
+    _say("read   - Read <len> bytes at <off> of a handle\n");
+    _say("write  - Write #<content> at <off> of a handle\n");
+    _say("seek   - Set the offset of a handle\n");
+    _say("close  - Close a handle\n");
+    _say("watch  - Watch a file/folder (-r for the whole subtree) and print its id\n");
+    _say("events - Print the changes seen by a watch\n");
+    _say("unwatch- Stop a watch\n");
+    _say("cksum  - Print the CRC32C of a file\n");
+    _say("verify - Check the files of a folder against their checksums\n");
+    _say("diff   - List what differs between two folders (+ only in the second, - only in the first, ~ changed)\n");
+    _say("begin  - Start a transaction (begin read: keep seeing the tree as it is now)\n");
+    _say("commit - Publish the changes of the transaction\n");
+    _say("abort  - Drop the changes of the transaction\n");
+    _say("help   - Show this menu\n");
 
-    if(strlen(newPassword) >= 127) return _TOO_LONG;
+    return _OK;
+}
 
-    strcpy(_curr_pass,newPassword);
-    printf("The password has been changed successfully!\n");
+int _print_user()
+{
+    if(_framed()) _emit_number(_FIELD_USER, vfs_session_user(_session));
+    else          (vfs_session_user(_session) == _CASUAL) ? printf("Casual\n") : printf("Superuser\n");
     return _OK;
 }
 
-//command executer
-int _exec(char** splt,int i, node* cwd, char* command)
+int _change_pass(char* newPassword)
 {
-    if(strcmp(splt[0],"ls")==0)
+    int status = vfs_change_password(_session, newPassword);
+    if(status == _OK) _say("The password has been changed successfully!\n");
+    return status;
+}
+
+int _stats()
+{
+    vfs_stats_t stats;
+    vfs_stats(_vfs, &stats);
+    if(_framed())
     {
-        if(i > 1)
-        { 
-            printf("Bad Usage! The right way is: ls\n");
-            return _INVALID_ARGUMENTS;
-        }
-        return _ls(cwd);
+        _emit_number(_FIELD_RECLAIM_BYTES, stats.reclaim_bytes);
+        _emit_number(_FIELD_RECLAIMED, stats.reclaimed);
+        return _OK;
+    }
+    printf("reclaim pending: %llu bytes\n", (unsigned long long)stats.reclaim_bytes);
+    printf("reclaimed:       %llu nodes\n", (unsigned long long)stats.reclaimed);
+    return _OK;
+}
+
+void _shutdown()
+{
+    vfs_destroy(_vfs);
+    _vfs     = NULL;
+    _session = NULL;
+}
+
+//command executer
+int _exec(char** splt,int i, char* command)
+{
+    if(strcmp(splt[0],"ls")==0)
+    {
+        return _ls(splt, i, NULL);
     }
     else if(strcmp(splt[0], "move")==0)
     {
         if(i != 3) 
         {
-            printf("Bad Usage! The right way is: move <nodePathorNameToBeMoved> <DestinationPath>\n");
+            _say("Bad Usage! The right way is: move <nodePathorNameToBeMoved> <DestinationPath>\n");
             return _INVALID_ARGUMENTS;
         }
 
@@ -756,16 +827,18 @@ int _exec(char** splt,int i, node* cwd, char* command)
 
         if(!source || !target || source[0] == '\0' || target[0] == '\0')
         {
-            printf("Source or destination cannot be empty!\n");
+            _say("Source or destination cannot be empty!\n");
             return _INVALID_ARGUMENTS;
         }
 
-        int status = _move(source,target,cwd);
+        int status = vfs_move(_session,source,target);
 
         if(status == _NOT_FOUND)
-            printf("File or directory couldn't be found!\n");
+            _say("File or directory couldn't be found!\n");
         else if(status == _NOT_A_DIRECTORY)
-            printf("Destination is not a directory!\n");
+            _say("Destination is not a directory!\n");
+        else if(status == _OBJECT_ALREADY_EXISTS)
+            _say("There is a file there with the same name!\n");
 
         return status;
     }
@@ -773,26 +846,26 @@ int _exec(char** splt,int i, node* cwd, char* command)
     {
         if(i != 2)
         {
-            printf("Bad Usage! The right way is: mkdir dirName\n");
+            _say("Bad Usage! The right way is: mkdir dirName\n");
             return _INVALID_ARGUMENTS;
         }
-        return _mkdir(cwd,splt[1],_curr_usr);
+        return vfs_mkdir(_session,splt[1]);
     }
     else if(strcmp(splt[0],"cd")==0)
     {
         if(i != 2)
         {
-            printf("Bad Usage! The right way is: cd dirName\n");
+            _say("Bad Usage! The right way is: cd dirName\n");
             return _INVALID_ARGUMENTS;
         }
-        return _cd(cwd,splt[1]);
+        return vfs_cd(_session,splt[1]);
     }
     else if(strcmp(splt[0],"change")==0)
     {
         if(i != 2) return _INVALID_ARGUMENTS;
         char* newpass = splt[1];
 
-        return _change_pass(_curr_usr,newpass);
+        return _change_pass(newpass);
     }
     else if(strcmp(splt[0],"rm")==0)
     {
@@ -810,11 +883,11 @@ int _exec(char** splt,int i, node* cwd, char* command)
         }
         else
         {
-            printf("Bad Usage! The right way is: rm [-f] dir/fileName\n");
+            _say("Bad Usage! The right way is: rm [-f] dir/fileName\n");
             return _INVALID_ARGUMENTS;
         }
 
-        return _rm(cwd, target_name, m,_curr_usr);
+        return _rm(target_name, m);
     }
     else if(strcmp(splt[0],"uprint")==0)
     {
@@ -824,24 +897,42 @@ int _exec(char** splt,int i, node* cwd, char* command)
     }
     else if(strcmp(splt[0],"switch")==0)
     {
-        if (_curr_usr == _CASUAL)
+        if (vfs_session_user(_session) == _CASUAL)
         {
             if (i != 2) return _INVALID_ARGUMENTS;
-            return _switch_users(_curr_usr, splt[1]);
+            return vfs_switch_user(_session, splt[1]);
         }
         else
         {
-            return _switch_users(_curr_usr, NULL);
+            return vfs_switch_user(_session, NULL);
         }
     }
     else if(strcmp(splt[0],"touch")==0)
     {
         if(i != 2)
         {
-            printf("Bad Usage! The right way is: touch fileName\n");
+            _say("Bad Usage! The right way is: touch fileName\n");
             return _INVALID_ARGUMENTS;
         }
-        return _touch(cwd,splt[1],_curr_usr);
+        return vfs_touch(_session,splt[1]);
+    }
+    else if(strcmp(splt[0],"chmod")==0)
+    {
+        if(i != 3)
+        {
+            _say("Bad Usage! The right way is: chmod <mode> <path>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _chmod(splt[1],splt[2]);
+    }
+    else if(strcmp(splt[0],"chown")==0)
+    {
+        if(i != 3)
+        {
+            _say("Bad Usage! The right way is: chown casual/superuser <path>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _chown(splt[1],splt[2]);
     }
     else if(strcmp(splt[0],"clear")==0)
     {
@@ -850,10 +941,22 @@ int _exec(char** splt,int i, node* cwd, char* command)
     }
     else if(strcmp(splt[0],"exit")==0)
     {
-        if(i > 1) return _INVALID_ARGUMENTS;
-        _free_node(_root);
+        if(i > 2 || (i == 2 && strcmp(splt[1], "-f") != 0)) return _INVALID_ARGUMENTS;
+
+        //exit never reaches the trace: the shell leaves before the line is recorded,
+        //and a replayed exit would end the replay before its report
+        _frame_end(_OK);
+
+        //-f leaves whatever rm still has to free to the OS
+        if(i == 2) vfs_abandon(_vfs);
+        else       _shutdown();
         exit(_OK);
     }
+    else if(strcmp(splt[0],"stats")==0)
+    {
+        if(i != 1) return _INVALID_ARGUMENTS;
+        return _stats();
+    }
     else if(strcmp(splt[0], "help")==0)
     {
         if(i != 1) return _INVALID_ARGUMENTS;
@@ -863,7 +966,7 @@ int _exec(char** splt,int i, node* cwd, char* command)
     {
         if(i < 4) 
         {
-            printf("Bad Usage! The right way is: insert >/>> <fileName> #<content>\n");
+            _say("Bad Usage! The right way is: insert >/>> <fileName> #<content>\n");
             return _INVALID_ARGUMENTS;
         }
         if(!splt[3]) return _INVALID_ARGUMENTS;
@@ -871,7 +974,7 @@ int _exec(char** splt,int i, node* cwd, char* command)
 
         if(splt[3][0] != hash)
         {
-            printf("Bad Usage! The right way is: insert >/>> <fileName> #<content>\n");
+            _say("Bad Usage! The right way is: insert >/>> <fileName> #<content>\n");
             return _INVALID_ARGUMENTS;
         }
         char* option = splt[1];
@@ -880,14 +983,120 @@ int _exec(char** splt,int i, node* cwd, char* command)
         command[strlen(command) -1] = '\0';
 
         content = _parse_command_for_insert(command);
+        if(strlen(content) > 1023) return _TOO_LONG;
+
+        bool append;
+        if(strcmp(option,">")==0)        append = false;
+        else if(strcmp(option,">>")==0) append = true;
+        else return _INVALID_ARGUMENTS;
 
-        return _insert(content,name,cwd,option,_curr_usr);
+        return vfs_insert(_session,name,(const uint8_t*)content,strlen(content),append);
     }
     else if(strcmp(splt[0], "print!") == 0)
     {
         if(i != 2) return _INVALID_ARGUMENTS;
         char* name = splt[1];
-        return _print(cwd,name,_curr_usr);
+        return _print(name);
+    }
+    else if(strcmp(splt[0], "open") == 0)
+    {
+        if(i != 2 && i != 3)
+        {
+            _say("Bad Usage! The right way is: open <path> [r|w|a]\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _open(splt[1], (i == 3) ? splt[2] : NULL);
+    }
+    else if(strcmp(splt[0], "read") == 0)
+    {
+        if(i != 4)
+        {
+            _say("Bad Usage! The right way is: read <fd> <off|-> <len>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _read(splt[1], splt[2], splt[3]);
+    }
+    else if(strcmp(splt[0], "write") == 0)
+    {
+        if(i < 4 || splt[3][0] != '#')
+        {
+            _say("Bad Usage! The right way is: write <fd> <off|-> #<content>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _write(splt[1], splt[2], command);
+    }
+    else if(strcmp(splt[0], "seek") == 0)
+    {
+        if(i != 3)
+        {
+            _say("Bad Usage! The right way is: seek <fd> <off>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _seek(splt[1], splt[2]);
+    }
+    else if(strcmp(splt[0], "close") == 0)
+    {
+        if(i != 2) return _INVALID_ARGUMENTS;
+        return _close(splt[1]);
+    }
+    else if(strcmp(splt[0], "watch") == 0)
+    {
+        if(i != 2 && i != 3)
+        {
+            _say("Bad Usage! The right way is: watch <path> [-r]\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _watch(splt[1], (i == 3) ? splt[2] : NULL);
+    }
+    else if(strcmp(splt[0], "events") == 0)
+    {
+        if(i != 2) return _INVALID_ARGUMENTS;
+        return _events(splt[1]);
+    }
+    else if(strcmp(splt[0], "unwatch") == 0)
+    {
+        int wd;
+        if(i != 2 || !_parse_fd(splt[1], &wd)) return _INVALID_ARGUMENTS;
+        return vfs_unwatch(_session, wd);
+    }
+    else if(strcmp(splt[0], "cksum") == 0)
+    {
+        if(i != 2) return _INVALID_ARGUMENTS;
+        return _cksum(splt[1]);
+    }
+    else if(strcmp(splt[0], "verify") == 0)
+    {
+        if(i > 2)
+        {
+            _say("Bad Usage! The right way is: verify [path]\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _verify((i == 2) ? splt[1] : NULL);
+    }
+    else if(strcmp(splt[0], "diff") == 0)
+    {
+        if(i != 3)
+        {
+            _say("Bad Usage! The right way is: diff <dirA> <dirB>\n");
+            return _INVALID_ARGUMENTS;
+        }
+        return _diff(splt[1], splt[2]);
+    }
+    else if(strcmp(splt[0], "begin") == 0)
+    {
+        if(i == 2 && strcmp(splt[1], "read") == 0) return vfs_begin_read(_session);
+        if(i != 1) return _INVALID_ARGUMENTS;
+        return vfs_begin(_session);
+    }
+    else if(strcmp(splt[0], "commit") == 0)
+    {
+        if(i != 1) return _INVALID_ARGUMENTS;
+        return vfs_commit(_session);
+    }
+    else if(strcmp(splt[0], "abort") == 0)
+    {
+        if(i != 1) return _INVALID_ARGUMENTS;
+        return vfs_abort(_session);
     }
     else
     {
@@ -895,77 +1104,574 @@ int _exec(char** splt,int i, node* cwd, char* command)
     }
 }
 
-int main()
+FILE*    _trace = NULL;
+uint64_t _trace_start;
+
+uint64_t _now_ns()
 {
-    init();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void _trace_close()
+{
+    if(_trace) fclose(_trace);
+    _trace = NULL;
+}
+
+int _trace_open(char* path)
+{
+    _trace = fopen(path, "wb");
+    if(!_trace) return _NOT_FOUND;
+
+    uint8_t version = TRACE_VERSION;
+    fwrite(TRACE_MAGIC, 1, 4, _trace);
+    fwrite(&version, 1, 1, _trace);
+    _trace_start = _now_ns();
+    atexit(_trace_close);
+    return _OK;
+}
+
+void _trace_write(trace_record* rec)
+{
+    fwrite(&rec->time_ns, sizeof(rec->time_ns), 1, _trace);
+    fwrite(&rec->user,    sizeof(rec->user),    1, _trace);
+    fwrite(&rec->flags,   sizeof(rec->flags),   1, _trace);
+    fwrite(&rec->status,  sizeof(rec->status),  1, _trace);
+    fwrite(&rec->length,  sizeof(rec->length),  1, _trace);
+    fwrite(rec->command,  1, rec->length, _trace);
+}
+
+bool _trace_read(FILE* in, trace_record* rec)
+{
+    if(fread(&rec->time_ns, sizeof(rec->time_ns), 1, in) != 1) return false;
+    if(fread(&rec->user,    sizeof(rec->user),    1, in) != 1) return false;
+    if(fread(&rec->flags,   sizeof(rec->flags),   1, in) != 1) return false;
+    if(fread(&rec->status,  sizeof(rec->status),  1, in) != 1) return false;
+    if(fread(&rec->length,  sizeof(rec->length),  1, in) != 1) return false;
+    if(rec->length >= sizeof(rec->command)) return false;
+    if(fread(rec->command, 1, rec->length, in) != rec->length) return false;
+    rec->command[rec->length] = '\0';
+    return true;
+}
 
+//passwords never reach the trace: every argument of switch and change becomes *
+bool _trace_mask(trace_record* rec)
+{
+    char* word = rec->command + strspn(rec->command, " ");
+    if(strncmp(word, "switch ", 7) != 0 && strncmp(word, "change ", 7) != 0) return false;
+
+    char   masked[sizeof(rec->command)];
+    size_t len = 0;
+    char*  save;
+    char   line[sizeof(rec->command)];
+    strcpy(line, rec->command);
+    line[strcspn(line, "\n")] = '\0';
+    for(char* token = strtok_r(line, " ", &save); token; token = strtok_r(NULL, " ", &save))
+    {
+        const char* shown = len ? "*" : token;
+        len += snprintf(masked + len, sizeof(masked) - len, len ? " %s" : "%s", shown);
+    }
+    len += snprintf(masked + len, sizeof(masked) - len, "\n");
+    memcpy(rec->command, masked, len + 1);
+    rec->length = (uint16_t)len;
+    return true;
+}
+
+//a fresh instance starts with the default password and replay keeps it: a masked command
+//that succeeded gets it back, one that failed gets a password that fails the same way
+void _trace_unmask(trace_record* rec)
+{
+    char wrong[130];
+    memset(wrong, 'x', sizeof(wrong) - 1);
+    wrong[sizeof(wrong) - 1] = '\0';
+    const char* password = (rec->status == _OK) ? "helloworld" : wrong;
+
+    char   line[sizeof(rec->command)];
+    size_t len = 0;
+    char*  save;
+    for(char* token = strtok_r(rec->command, " \n", &save); token; token = strtok_r(NULL, " \n", &save))
+    {
+        const char* shown = (len && strcmp(token, "*") == 0) ? password : token;
+        len += snprintf(line + len, sizeof(line) - len, len ? " %s" : "%s", shown);
+    }
+    snprintf(line + len, sizeof(line) - len, "\n");
+    strcpy(rec->command, line);
+    rec->length = (uint16_t)strlen(line);
+}
+
+void _print_error(int status)
+{
+    switch (status)
+    {
+        case _COMMAND_NOT_FOUND:
+            printf("Sorry, your command is invalid!\n");
+            break;
+        case _INVALID_ARGUMENTS:
+            printf("Sorry, your arguments are invalid!\n");
+            break;
+        case _ILLEGAL_CHARACTER:
+            printf("Your statement includes illegal characters!\n");
+            break;
+        case _NOT_FOUND:
+            printf("File/Directory could not be found!\n");
+            break;
+        case _OBJECT_ALREADY_EXISTS:
+            printf("File/Directory already exists!\n");
+            break;
+        case _NOT_A_DIRECTORY:
+            printf("Not a directory!\n");
+            break;
+        case _TOO_LONG:
+            printf("The name/content is too long!\n");
+            break;
+        case _NOT_A_FILE:
+            printf("Not a file!\n");
+            break;
+        case _PERMISSION_DENIED:
+            printf("You don't have the permission to make this action!\n");
+            break;
+        case _WRONG_PASSWORD:
+            printf("Wrong password!\n");
+            break;
+        case _NOT_IN_TRANSACTION:
+            printf("There is no open transaction!\n");
+            break;
+        case _ALREADY_IN_TRANSACTION:
+            printf("A transaction is already open!\n");
+            break;
+        case _CONFLICT:
+            printf("The tree was changed by someone else, the transaction was aborted!\n");
+            break;
+        case _CORRUPTED:
+            printf("Some files no longer match their checksums!\n");
+            break;
+        case _IN_USE:
+            printf("Cannot delete current working directory!\n");
+            break;
+    }
+}
+
+//keep the lines of in that contain pattern
+int _grep(const char* pattern, pipe_buffer* in, pipe_buffer* out)
+{
+    size_t         plen = strlen(pattern);
+    const uint8_t* cur  = in->data;
+    const uint8_t* end  = in->data + in->len;
+
+    while(cur < end)
+    {
+        const uint8_t* nl   = memchr(cur, '\n', end - cur);
+        const uint8_t* stop = nl ? nl + 1 : end;
+
+        bool found = (plen == 0);
+        for(const uint8_t* at = cur; !found && (size_t)(stop - at) >= plen; at++)
+        {
+            at = memchr(at, pattern[0], (stop - at) - plen + 1);
+            if(!at) break;
+            found = (memcmp(at, pattern, plen) == 0);
+        }
+        if(found && !_pipe_append(out, cur, stop - cur)) return _INVALID_ARGUMENTS;
+        cur = stop;
+    }
+    return _OK;
+}
+
+bool _is_redirect(char* token)
+{
+    return strcmp(token, ">") == 0 || strcmp(token, ">>") == 0;
+}
+
+//one stage of a pipeline, in is NULL for the first one
+int _stage(char** splt, int i, pipe_buffer* in, pipe_buffer* out)
+{
+    if(strcmp(splt[0], "insert") == 0)
+    {
+        if(i != 3 || !in || !_is_redirect(splt[1])) return _INVALID_ARGUMENTS;
+        return vfs_insert(_session, splt[2], in->data, in->len, splt[1][1] == '>');
+    }
+
+    //a trailing > or >> sends the output into a file instead of the next stage
+    char* target = NULL;
+    bool  append = false;
+    if(i >= 3 && _is_redirect(splt[i - 2]))
+    {
+        append = (splt[i - 2][1] == '>');
+        target = splt[i - 1];
+        i -= 2;
+    }
+
+    int status;
+    if(strcmp(splt[0], "print!") == 0)
+    {
+        if(i != 2 || in) return _INVALID_ARGUMENTS;
+        status = vfs_read(_session, splt[1], &out->data, &out->len);
+    }
+    else if(strcmp(splt[0], "ls") == 0)
+    {
+        if(in) return _INVALID_ARGUMENTS;
+        status = _ls(splt, i, out);
+    }
+    else if(strcmp(splt[0], "grep") == 0)
+    {
+        if(i != 2 || !in) return _INVALID_ARGUMENTS;
+        status = _grep(splt[1], in, out);
+    }
+    else
+    {
+        return _COMMAND_NOT_FOUND;
+    }
+
+    if(status == _OK && target)
+    {
+        //like a shell redirect, a missing file is created first
+        status = vfs_insert(_session, target, out->data, out->len, append);
+        if(status == _NOT_FOUND && vfs_touch(_session, target) == _OK)
+            status = vfs_insert(_session, target, out->data, out->len, append);
+        _pipe_drop(out);
+    }
+    return status;
+}
+
+//stages separated by |: every stage gets the output of the one before, file
+//contents are passed on as views into the tree and never formatted or copied
+int _run_pipeline(char* line)
+{
+    char text[2048];
+    strcpy(text, line);
+    text[strcspn(text, "\n")] = '\0';
+
+    pipe_buffer in    = {0};
+    bool        first = true;
+    int         status = _OK;
+
+    char* save_stage;
+    for(char* part = strtok_r(text, "|", &save_stage); part; part = strtok_r(NULL, "|", &save_stage))
+    {
+        char* splt[32];
+        char* save_token;
+        int   i = 0;
+        for(char* token = strtok_r(part, " ", &save_token); token && i < 31; token = strtok_r(NULL, " ", &save_token))
+        {
+            splt[i++] = token;
+        }
+        if(i == 0)
+        {
+            status = _INVALID_ARGUMENTS;
+            break;
+        }
+        splt[i] = NULL;
+
+        pipe_buffer out = {0};
+        status = _stage(splt, i, first ? NULL : &in, &out);
+        _pipe_drop(&in);
+        in    = out;
+        first = false;
+        if(status != _OK) break;
+    }
+
+    if(status == _OK && _framed()) _emit_data(in.data, in.len);
+    else if(status == _OK && in.len) fwrite(in.data, 1, in.len, stdout);
+    _pipe_drop(&in);
+    return status;
+}
+
+//split a raw input line (with its newline) and hand it to _exec
+int _dispatch_line(char* line)
+{
     char command[2048];
+    char q[2048];
     char* del = " ";
 
-    _curr_dir = _root;
+    strcpy(q,line);
+    strcpy(command,line);
+    command[strcspn(command, "\n")] = '\0';
+
+    char* token = strtok(command,del);
+    char* splitted_code[32];
+    int i = 0;
+    while (token && i < 31)
+    {
+        splitted_code[i] = token;
+        token = strtok(NULL,del);
+        ++i;
+    }
+    if(i >= 31)
+    {
+        _say("Too many arguments!\n");
+    }
+    if(i == 0) return _OK;
+
+    splitted_code[i] = NULL;
+
+    //a | before the # of literal text, or a redirect after a producer, makes a pipeline
+    bool producer = strcmp(splitted_code[0], "print!") == 0 || strcmp(splitted_code[0], "ls") == 0;
+    if(memchr(q, '|', strcspn(q, "#")) || (producer && i >= 3 && _is_redirect(splitted_code[i - 2])))
+    {
+        return _run_pipeline(q);
+    }
+    return _exec(splitted_code,i,q);
+}
+
+//framed output gets exactly one record per line
+int _run_line(char* line)
+{
+    _frame_begin();
+    int status = _dispatch_line(line);
+    _frame_end(status);
+    return status;
+}
+
+int _compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+//latencies of the replayed commands that share a name
+typedef struct
+{
+    char      name[16];
+    uint64_t* ns;
+    size_t    count;
+    size_t    capacity;
+} latency_list;
+
+bool _latency_add(latency_list* list, uint64_t ns)
+{
+    if(list->count == list->capacity)
+    {
+        size_t    capacity = list->capacity ? 2 * list->capacity : 64;
+        uint64_t* grown    = realloc(list->ns, capacity * sizeof(uint64_t));
+        if(!grown) return false;
+        list->ns       = grown;
+        list->capacity = capacity;
+    }
+    list->ns[list->count++] = ns;
+    return true;
+}
+
+//the list of the command name that line starts with, NULL once lists are full
+latency_list* _latency_of(latency_list* lists, size_t* nlists, size_t max, const char* line)
+{
+    char   name[16];
+    size_t len = strcspn(line, " \n");
+    if(len >= sizeof(name)) len = sizeof(name) - 1;
+    memcpy(name, line, len);
+    name[len] = '\0';
+
+    for(size_t k = 0; k < *nlists; k++)
+    {
+        if(strcmp(lists[k].name, name) == 0) return &lists[k];
+    }
+    if(*nlists == max) return NULL;
+
+    latency_list* list = &lists[(*nlists)++];
+    memset(list, 0, sizeof(*list));
+    strcpy(list->name, name);
+    return list;
+}
+
+void _latency_report(const char* label, latency_list* list)
+{
+    if(!list->count) return;
+
+    uint64_t sum = 0;
+    for(size_t k = 0; k < list->count; k++) sum += list->ns[k];
+    qsort(list->ns, list->count, sizeof(uint64_t), _compare_u64);
+    fprintf(stderr, "%-10s %8zu  min %llu avg %llu p50 %llu p99 %llu max %llu\n", label, list->count,
+            (unsigned long long)list->ns[0],
+            (unsigned long long)(sum / list->count),
+            (unsigned long long)list->ns[list->count / 2],
+            (unsigned long long)list->ns[(list->count * 99) / 100],
+            (unsigned long long)list->ns[list->count - 1]);
+}
+
+//run a recorded trace again; speed 0 means as fast as possible
+int _replay(char* path, double speed)
+{
+    FILE* in = fopen(path, "rb");
+    if(!in) return _NOT_FOUND;
+
+    char magic[4];
+    uint8_t version;
+    if(fread(magic, 1, 4, in) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0 ||
+       fread(&version, 1, 1, in) != 1 || version != TRACE_VERSION)
+    {
+        fclose(in);
+        return _INVALID_ARGUMENTS;
+    }
+
+    //all commands, and each command name on its own
+    size_t       count = 0, diverged = 0, declined = 0, nnames = 0;
+    latency_list all   = {0};
+    latency_list names[32];
+
+    //replayed commands cannot answer the rm confirmation
+    _interactive = false;
+
+    trace_record rec;
+    uint64_t start = _now_ns();
+    while(_trace_read(in, &rec))
+    {
+        if(speed > 0)
+        {
+            uint64_t due = start + (uint64_t)(rec.time_ns / speed);
+            uint64_t now = _now_ns();
+            if(due > now)
+            {
+                struct timespec ts = { (time_t)((due - now) / 1000000000ull), (long)((due - now) % 1000000000ull) };
+                nanosleep(&ts, NULL);
+            }
+        }
+
+        //a user mismatch means an earlier divergence changed the session
+        if(vfs_session_user(_session) != (users)rec.user)
+        {
+            ++diverged;
+            fprintf(stderr, "user mismatch before #%zu: %.*s\n",
+                    count + 1, (int)strcspn(rec.command, "\n"), rec.command);
+        }
+
+        //the recorded outcome of an unconfirmed rm is that nothing happened
+        if(rec.flags & TRACE_DECLINED)
+        {
+            ++declined;
+            continue;
+        }
+        if(rec.flags & TRACE_MASKED) _trace_unmask(&rec);
+
+        uint64_t t0 = _now_ns();
+        int status = _run_line(rec.command);
+        uint64_t t1 = _now_ns();
+
+        latency_list* named = _latency_of(names, &nnames, sizeof(names) / sizeof(names[0]),
+                                          rec.command + strspn(rec.command, " "));
+        if(!_latency_add(&all, t1 - t0)) break;
+        if(named && !_latency_add(named, t1 - t0)) break;
+        count++;
+
+        if(status != rec.status)
+        {
+            ++diverged;
+            fprintf(stderr, "divergence at #%zu: %.*s expected %d, got %d\n",
+                    count, (int)strcspn(rec.command, "\n"), rec.command, rec.status, status);
+        }
+    }
+    uint64_t total = _now_ns() - start;
+    fclose(in);
+
+    fprintf(stderr, "replayed %zu commands in %.3f ms, %zu diverged, %zu declined rm skipped\n",
+            count, total / 1e6, diverged, declined);
+    if(count) fprintf(stderr, "latency ns   commands\n");
+    _latency_report("all", &all);
+    free(all.ns);
+    for(size_t k = 0; k < nnames; k++)
+    {
+        _latency_report(names[k].name, &names[k]);
+        free(names[k].ns);
+    }
+    return diverged ? _INVALID_ARGUMENTS : _OK;
+}
+
+void _usage()
+{
+    printf("Usage: vfs [--record <file>] [--output=text|binary|json]\n");
+    printf("       vfs --replay <file> [--speed <N> | --fast] [--output=text|binary|json]\n");
+}
+
+int main(int argc, char** argv)
+{
+    init();
+
+    char*  record_path = NULL;
+    char*  replay_path = NULL;
+    double speed       = 1.0;
+
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "--record") == 0 && a + 1 < argc)      record_path = argv[++a];
+        else if(strcmp(argv[a], "--replay") == 0 && a + 1 < argc) replay_path = argv[++a];
+        else if(strcmp(argv[a], "--speed") == 0 && a + 1 < argc)
+        {
+            //a factor above 0; 0 or less, junk and overflow are refused, --fast is for no waiting
+            char* end;
+            speed = strtod(argv[++a], &end);
+            if(end == argv[a] || *end != '\0' || !(speed > 0) || speed == HUGE_VAL)
+            {
+                _usage();
+                return _INVALID_ARGUMENTS;
+            }
+        }
+        else if(strcmp(argv[a], "--fast") == 0)                   speed = 0;
+        else if(strcmp(argv[a], "--output=text") == 0)            _output = _OUT_TEXT;
+        else if(strcmp(argv[a], "--output=binary") == 0)          _output = _OUT_BINARY;
+        else if(strcmp(argv[a], "--output=json") == 0)            _output = _OUT_JSON;
+        else
+        {
+            _usage();
+            return _INVALID_ARGUMENTS;
+        }
+    }
+
+    //programs cannot answer prompts
+    if(_framed())
+    {
+        _interactive = false;
+        atexit(_frame_flush);
+    }
+
+    if(replay_path)
+    {
+        int status = _replay(replay_path, speed);
+        _shutdown();
+        return status;
+    }
+
+    if(record_path && _trace_open(record_path) != _OK)
+    {
+        printf("Cannot open the trace file!\n");
+        return _NOT_FOUND;
+    }
+
+    char command[2048];
 
     while(true)
     {
-        char* abspath = _get_absolute_path(_curr_dir);
-        printf("%s$", abspath);
-        free(abspath);
-        fgets(command,2048,stdin);
-        char q[2048];
-        strcpy(q,command);
-        command[strcspn(command, "\n")] = '\0';
-        char* token = strtok(command,del);
-        char* splitted_code[32];
-        int i = 0;
-        while (token && i < 31)
-        {
-            splitted_code[i] = token;
-            token = strtok(NULL,del);
-            ++i;
-        }
-        if(i >= 31)
-        {
-            printf("Too many arguments!\n");
-        }
-        
-        int argc = i;
-        int STATUS = _exec(splitted_code,argc,_curr_dir, q);
-        switch (STATUS)
-        {
-            case _COMMAND_NOT_FOUND:
-                printf("Sorry, your command is invalid!\n");
-                break;
-            case _INVALID_ARGUMENTS:
-                printf("Sorry, your arguments are invalid!\n");
-                break;
-            case _ILLEGAL_CHARACTER:
-                printf("Your statement includes illegal characters!\n");
-                break;
-            case _NOT_FOUND:
-                printf("File/Directory could not be found!\n");
-                break;
-            case _OBJECT_ALREADY_EXISTS:
-                printf("File/Directory already exists!\n");
-                break;
-            case _NOT_A_DIRECTORY:
-                printf("Not a directory!\n");
-                break;
-            case _TOO_LONG:
-                printf("The name/content is too long!\n");
-                break;
-            case _NOT_A_FILE:
-                printf("Not a file!\n");
-                break;
-            case _PERMISSION_DENIED:
-                printf("You don't have the permission to make this action!\n");
-                break;
-            case _WRONG_PASSWORD:
-                printf("Wrong password!\n");
-                break;
-        }
-
-        splitted_code[i] = NULL;
-        
-    }
-    _free_node(_root);
+        if(_framed())
+        {
+            _frame_flush();
+        }
+        else
+        {
+            char* abspath = vfs_getcwd(_session);
+            printf("%s$", abspath);
+            free(abspath);
+        }
+        if(!fgets(command,2048,stdin)) break;
+
+        trace_record rec;
+        rec.time_ns = _trace ? _now_ns() - _trace_start : 0;
+        rec.user    = (uint8_t)vfs_session_user(_session);
+
+        _trace_line[0] = '\0';
+        _trace_flags   = 0;
+        int STATUS = _run_line(command);
+        if(!_framed()) _print_error(STATUS);
+
+        if(_trace)
+        {
+            const char* line = _trace_line[0] ? _trace_line : command;
+            rec.status = STATUS;
+            rec.flags  = _trace_flags;
+            rec.length = (uint16_t)strlen(line);
+            memcpy(rec.command, line, rec.length + 1);
+            if(_trace_mask(&rec)) rec.flags |= TRACE_MASKED;
+            _trace_write(&rec);
+        }
+    }
+    _shutdown();
     return 0;
 }
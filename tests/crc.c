@@ -0,0 +1,83 @@
+//verify has to notice bytes that change behind the instance's back after appends,
+//overwrites and writes in the middle of a file; exits non-zero on the first miss
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vfs.h"
+
+vfs_t*         _fs;
+vfs_session_t* _s;
+
+void _expect(vfs_error_t got, vfs_error_t want, const char* what)
+{
+    if(got == want) return;
+    printf("FAIL %s: got %d, expected %d\n", what, got, want);
+    exit(1);
+}
+
+//flip a bit of the file's contents without the instance knowing
+void _corrupt(const char* path, size_t at)
+{
+    const uint8_t* data;
+    size_t         len;
+    _expect(vfs_read(_s, path, &data, &len), _OK, "read before corrupting");
+    ((uint8_t*)data)[at % len] ^= 1;
+}
+
+//a fresh directory /name holding a file f of 4 KiB
+void _file(const char* name)
+{
+    uint8_t bytes[4096];
+    memset(bytes, 'a', sizeof(bytes));
+    vfs_cd(_s, "/");
+    _expect(vfs_mkdir(_s, name), _OK, "mkdir");
+    _expect(vfs_cd(_s, name), _OK, "cd");
+    _expect(vfs_touch(_s, "f"), _OK, "touch");
+    _expect(vfs_insert(_s, "f", bytes, sizeof(bytes), false), _OK, "insert");
+}
+
+vfs_error_t _verify()
+{
+    size_t checked;
+    return vfs_verify(_s, NULL, NULL, NULL, &checked);
+}
+
+int main()
+{
+    uint8_t  other[4096];
+    uint32_t crc;
+    int      fd;
+    memset(other, 'b', sizeof(other));
+
+    _fs = vfs_create();
+    _s  = vfs_session_open(_fs);
+
+    _file("append");
+    _expect(vfs_insert(_s, "f", other, 100, true), _OK, "append");
+    _expect(_verify(), _OK, "verify after append");
+    _corrupt("f", 10);
+    _expect(_verify(), _CORRUPTED, "verify of a corrupted append");
+
+    //an overwrite checksums the new contents right away
+    _file("overwrite");
+    _expect(vfs_checksum(_s, "f", &crc), _OK, "cksum");
+    _expect(vfs_insert(_s, "f", other, sizeof(other), false), _OK, "overwrite");
+    _corrupt("f", 10);
+    _expect(_verify(), _CORRUPTED, "verify of a corrupted overwrite");
+
+    //a write in the middle drops the checksum, the first one sealed after it is the reference
+    _file("middle");
+    _expect(vfs_open(_s, "f", _WRITE, &fd), _OK, "open");
+    _expect(vfs_pwrite(_s, fd, 0, other, sizeof(other)), _OK, "pwrite");
+    _expect(vfs_pwrite(_s, fd, 100, other, 10), _OK, "pwrite in the middle");
+    _expect(vfs_close(_s, fd), _OK, "close");
+    _expect(_verify(), _OK, "verify after a write in the middle");
+    _expect(_verify(), _OK, "verify against the sealed checksum");
+    _corrupt("f", 4000);
+    _expect(_verify(), _CORRUPTED, "verify of a corrupted file with a sealed checksum");
+
+    vfs_session_close(_s);
+    vfs_destroy(_fs);
+    printf("crc: ok\n");
+    return 0;
+}
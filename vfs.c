@@ -0,0 +1,3217 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "vfs.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define VFS_HAVE_SSE42
+#endif
+
+//crc32c (Castagnoli) of file contents: the crc32 instruction where the cpu has it,
+//slicing-by-8 tables everywhere else, picked once at run time
+#define CRC32C_POLY 0x82F63B78u
+
+//verify runs on at most this many threads, small subtrees stay on the caller's
+#define VFS_VERIFY_THREADS 8
+#define VFS_VERIFY_SERIAL  (1u << 20)
+
+//seeds that keep files, directories and names apart in the merkle hashes
+#define HASH_K         0x9E3779B97F4A7C15ull
+#define HASH_SEED_FILE 1
+#define HASH_SEED_DIR  2
+#define HASH_SEED_NAME 3
+
+//removed subtrees are freed by a background thread, this many nodes between two looks at the stop flag
+#define VFS_RECLAIM_BATCH 4096
+
+//order-maintenance list: every node owns an open and a close tag placed like an
+//Euler tour of the tree, so ancestry becomes a comparison of two labels
+#define OM_BITS      62
+#define OM_THRESHOLD 1.3
+
+typedef struct om_tag
+{
+    uint64_t       label;
+    struct om_tag* prev;
+    struct om_tag* next;
+} om_tag;
+
+//change events: every watch has a bounded queue of its own with the writer as the
+//only producer and the owning session as the only consumer. Events of a batch are
+//staged as they happen and become readable at its commit; a full queue counts what it drops
+#define VFS_WATCH_QUEUE 1024
+
+typedef struct watch
+{
+    size_t           ref;          // index in vfs.watching
+    uint64_t         marked;       // the move whose old place this watch saw
+    uint64_t         staged;       // end of the events of the open batch, writer only
+    uint64_t         staged_lost;
+    bool             in_batch;     // on the staged list of the instance
+    struct watch*    staged_next;
+    _Atomic uint64_t head;         // events before head are readable
+    _Atomic uint64_t tail;         // events before tail were read
+    _Atomic uint64_t lost;
+    vfs_event_t      events[VFS_WATCH_QUEUE];
+} watch;
+
+//what the writer matches a watch by, all watches in one array so that a scan stays in cache
+typedef struct
+{
+    struct node* target;   // NULL once the node is gone
+    watch*       w;
+    bool         recursive;
+} watch_ref;
+
+//multi-version concurrency: a node is a stable identity with a chain of revisions,
+//newest first, each stamped with the version that published it. Readers pin a
+//version under pin_lock, which no write holds while it works, and then read without
+//locks; the one writer of the instance copies the revisions it changes and those of
+//their ancestors, so a committed revision never changes again
+#define VFS_UNCOMMITTED UINT64_MAX
+
+//file contents, shared by the revisions of a file until one of them writes where another reads
+typedef struct
+{
+    _Atomic uint32_t refs;   // revisions pointing here
+    size_t           cap;
+    size_t           used;   // bytes ever written, an append right there overwrites nothing
+    uint8_t          bytes[];
+} blob;
+
+struct node;
+
+//a child of a directory by sequence number; gone is the version that unlinked it
+typedef struct
+{
+    uint64_t         seq;
+    struct node*     nd;
+    _Atomic uint64_t gone;   // UINT64_MAX while linked
+} seq_slot;
+
+//the children a directory ever had, by rising sequence number, so a listing resumes from a
+//cursor by binary search; shared by the revisions of the directory like a blob.
+//Behind the cap slots, 2 * cap cells of open addressing by name hold slot position + 1
+//(0 = empty), so a name is found without walking the children
+typedef struct
+{
+    _Atomic uint32_t refs;
+    size_t           cap;    // a power of two
+    size_t           used;
+    seq_slot         at[];
+} seq_index;
+
+//directories with up to this many children ever listed are searched by walking the list
+#define NAME_SCAN 16
+
+//a move of a subtree with up to this many tags forgets the traversal rights cached below it,
+//a bigger one those of the whole instance
+#define SCOPED_MOVE_TAGS 8192
+
+typedef struct rev
+{
+    uint64_t     begin;      // version that published it, VFS_UNCOMMITTED while private to a batch
+    struct rev*  prev;       // the revision it replaced
+    struct rev*  retired;    // next replaced revision of the same commit
+    struct node* parent;
+    struct node* sibling;
+    struct node* children;
+    uint64_t     seq;        // position in the parent, newer children get larger numbers
+    uint64_t     next_seq;   // for the children of a directory
+    size_t       size;
+    size_t       tags;       // order-maintenance tags of the subtree, two per node
+    blob*        data;
+    seq_index*   index;      // the first nindex slots belong to this revision
+    size_t       nindex;
+    size_t       ndead;      // slots of unlinked children among them
+    users        owner;
+    uint8_t      mode;
+
+    //crc32c of the first crc_len bytes of data, kept up by the writer; sealed is the crc
+    //of all size bytes with bit 32 set, filled in by whoever asks first
+    uint32_t         crc;
+    size_t           crc_len;
+    _Atomic uint64_t sealed;
+
+    //merkle hash of the contents (files) or of the names and hashes of the children
+    //(directories); a dirty revision is recomputed on demand and so are all of its ancestors
+    _Atomic uint64_t hash;
+    _Atomic bool     hash_dirty;
+} rev;
+
+//set up the file system
+typedef struct node
+{
+    char          name[32];
+    uint64_t      id;
+    node_types    type;
+    _Atomic(rev*) cur;       // newest committed revision, NULL until the first commit
+    rev*          work;      // private revision of the open batch
+    struct node*  link;      // next node the batch touched, later next removed subtree
+    uint32_t      refs;      // open handles
+    bool          orphan;    // removed from the tree while still open
+    bool          removed;   // root of a removed subtree
+
+    //cached result of _traverse_mask as generation << 8 | mask, valid in views of that generation
+    //and in later ones as long as neither rights nor the ancestors of the node changed since;
+    //trav_floor is the generation of the last move that gave it new ancestors
+    _Atomic uint64_t trav;
+    _Atomic uint64_t trav_floor;
+
+    //the subtree of this node in the newest tree is exactly the tags between open and close
+    om_tag        open;
+    om_tag        close;
+} node;
+
+//what one call sees: a committed version, or the open batch on top of the newest one
+typedef struct
+{
+    uint64_t version;
+    uint64_t perm_gen;
+    uint64_t rights_gen;   // generation of the last chmod or chown it sees
+    bool     work;
+} view;
+
+//a committed version with the readers still using it, oldest first
+typedef struct snapshot
+{
+    uint64_t         version;
+    uint64_t         perm_gen;
+    uint64_t         rights_gen;
+    uint64_t         readers;
+    struct snapshot* newer;
+} snapshot;
+
+//what a commit left behind, freed once no reader is older than stamp
+typedef struct garbage
+{
+    uint64_t        stamp;
+    rev*            revs;    // replaced revisions, chained through retired
+    node*           trees;   // removed subtrees, chained through link
+    uint64_t        bytes;   // file contents of the removed subtrees
+    vfs_t*          owner;   // set once it is queued for the reclaimer
+    struct garbage* next;
+} garbage;
+
+//undo log of the order-maintenance list, an aborted batch replays it backwards
+typedef struct
+{
+    node*   nd;
+    om_tag* after;   // NULL for a link, else the tag the unlinked range followed
+    size_t  tags;
+} om_undo;
+
+//file is swapped for an orphan copy by the writer when its subtree is removed
+typedef struct
+{
+    _Atomic(node*) file;   // NULL for a free slot
+    size_t     offset;
+    open_modes mode;
+} vfs_handle;
+
+enum
+{
+    TXN_NONE,
+    TXN_WRITE,
+    TXN_READ
+};
+
+struct vfs_session
+{
+    vfs_t*          vfs;
+    _Atomic(node*)  cwd;
+    users           user;
+    vfs_session_t*  next;
+
+    vfs_handle*     handles;
+    int             nhandles;
+    watch**         watches;   // NULL for a free slot
+    int             nwatches;
+
+    _Atomic uint8_t txn;
+    snapshot*       snap;   // version of a read transaction
+};
+
+struct vfs
+{
+    node*    root;
+    uint64_t version;   // newest committed version
+    uint64_t perm_gen;    // last generation handed out, bumped whenever traversal rights may change
+    uint64_t work_gen;    // generation of the open batch
+    uint64_t work_rights; // generation of the last chmod or chown the open batch sees
+    char     pass[128];
+
+    //one writer at a time; it also guards sessions, handles, watches and the order-maintenance list
+    pthread_mutex_t write_lock;
+    vfs_session_t*  txn_owner;
+    pthread_cond_t  txn_done;   // the open transaction ended, waiting writers go on
+
+    //the open batch: an explicit transaction or the one command being run
+    node*    touched;
+    node**   removed;
+    size_t   nremoved;
+    size_t   removed_cap;
+    om_undo* undo;
+    size_t   nundo;
+    size_t   undo_cap;
+    seq_slot** unlisted;     // index slots the batch marked gone in committed revisions
+    size_t     nunlisted;
+    size_t     unlisted_cap;
+
+    //versions readers may still use and what they keep alive
+    pthread_mutex_t pin_lock;
+    snapshot*       oldest;
+    snapshot*       head;
+    garbage*        garbage_first;
+    garbage*        garbage_last;
+
+    vfs_session_t* sessions;
+    uint64_t       next_id;
+
+    watch_ref* watching;
+    size_t     nwatching;
+    size_t     watching_cap;
+    watch*     staged;    // watches with events in the open batch
+    uint64_t   moves;     // numbers the moves, see watch.marked
+
+    //garbage too big to free on the spot waits for the reclaimer
+    size_t           reclaim_queued;  // items queued or being freed, under _reclaim.lock
+    _Atomic bool     reclaim_abandon;
+    _Atomic uint64_t reclaim_bytes;
+    _Atomic uint64_t reclaimed;
+};
+
+
+static uint32_t        _crc_table[8][256];
+static uint32_t        (*_crc_kernel)(uint32_t crc, const uint8_t* p, size_t n);
+static pthread_once_t  _crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t _crc32c_sw(uint32_t crc, const uint8_t* p, size_t n)
+{
+    while(n && ((uintptr_t)p & 7))
+    {
+        crc = _crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+
+    //eight bytes per step, one table per byte position
+    while(n >= 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = _crc_table[7][lo & 0xff] ^ _crc_table[6][(lo >> 8) & 0xff] ^
+              _crc_table[5][(lo >> 16) & 0xff] ^ _crc_table[4][lo >> 24] ^
+              _crc_table[3][hi & 0xff] ^ _crc_table[2][(hi >> 8) & 0xff] ^
+              _crc_table[1][(hi >> 16) & 0xff] ^ _crc_table[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+
+    while(n--)
+    {
+        crc = _crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef VFS_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_hw(uint32_t crc, const uint8_t* p, size_t n)
+{
+    while(n && ((uintptr_t)p & 7))
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+
+    uint64_t wide = crc;
+    while(n >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        wide = _mm_crc32_u64(wide, word);
+        p += 8;
+        n -= 8;
+    }
+    crc = (uint32_t)wide;
+
+    while(n--)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static void _crc_init(void)
+{
+    for(uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for(int k = 0; k < 8; k++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        _crc_table[0][b] = crc;
+    }
+    for(uint32_t b = 0; b < 256; b++)
+    {
+        for(int t = 1; t < 8; t++)
+        {
+            _crc_table[t][b] = (_crc_table[t - 1][b] >> 8) ^ _crc_table[0][_crc_table[t - 1][b] & 0xff];
+        }
+    }
+
+    _crc_kernel = _crc32c_sw;
+#ifdef VFS_HAVE_SSE42
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2")) _crc_kernel = _crc32c_hw;
+#endif
+}
+
+//continue crc over n more bytes, start with 0
+static uint32_t _crc32c(uint32_t crc, const uint8_t* p, size_t n)
+{
+    return ~_crc_kernel(~crc, p, n);
+}
+
+//the revision of n that v sees, NULL if n is newer than v
+static rev* _rev(const view* v, node* n)
+{
+    if(v->work && n->work) return n->work;
+
+    rev* r = atomic_load_explicit(&n->cur, memory_order_acquire);
+    while(r && r->begin > v->version)
+    {
+        r = r->prev;
+    }
+    return r;
+}
+
+//the revision the writer sees, only under the write lock
+static rev* _newest(node* n)
+{
+    return n->work ? n->work : atomic_load_explicit(&n->cur, memory_order_relaxed);
+}
+
+static uint8_t* _bytes(rev* r)
+{
+    return r->data ? r->data->bytes : NULL;
+}
+
+static bool _is_allowed(rev* nodeToAccess, users user, uint8_t want)
+{
+    if(!nodeToAccess) return false;
+    if(user == _SUPERUSER) return true;
+
+    uint8_t bits = (nodeToAccess->owner == user) ? (nodeToAccess->mode >> 3) : nodeToAccess->mode;
+    return (bits & want) == want;
+}
+
+//bit u is set if user u may pass through dir and every directory above it; views of the
+//same generation agree on it, so one cache per node serves every reader
+static uint8_t _traverse_mask(const view* v, node* dir)
+{
+    uint64_t cached = atomic_load_explicit(&dir->trav, memory_order_acquire);
+    uint64_t gen    = cached >> 8;
+    if(gen == v->perm_gen) return (uint8_t)cached;
+
+    //an older mask still holds if no rights changed since and no move gave dir new ancestors
+    if(gen && gen < v->perm_gen && v->rights_gen <= gen &&
+       atomic_load_explicit(&dir->trav_floor, memory_order_relaxed) <= gen)
+    {
+        return (uint8_t)cached;
+    }
+
+    rev*    r    = _rev(v, dir);
+    uint8_t mask = r->parent ? _traverse_mask(v, r->parent) : 0xff;
+    if(!_is_allowed(r, _CASUAL, VFS_X))    mask &= ~(1u << _CASUAL);
+    if(!_is_allowed(r, _SUPERUSER, VFS_X)) mask &= ~(1u << _SUPERUSER);
+
+    atomic_store_explicit(&dir->trav, v->perm_gen << 8 | mask, memory_order_release);
+    return mask;
+}
+
+static bool _can_traverse(vfs_session_t* s, const view* v, node* dir)
+{
+    return (_traverse_mask(v, dir) >> s->user) & 1;
+}
+
+//files are readable by everyone, superuser files stay private to the superuser
+static uint8_t _default_mode(node_types type, users owner)
+{
+    uint8_t own = (type == _DIR) ? (VFS_R | VFS_W | VFS_X) : (VFS_R | VFS_W);
+    uint8_t oth = (type == _DIR) ? (VFS_R | VFS_X) : VFS_R;
+    if(owner == _SUPERUSER) oth = 0;
+    return VFS_OWNER(own) | VFS_OTHER(oth);
+}
+
+//link the chain first..last (m tags) right after x and give it labels,
+//relabelling the smallest sparse enough aligned range around x if there is no room
+static void _om_insert_after(om_tag* x, om_tag* first, om_tag* last, size_t m)
+{
+    om_tag* next = x->next;
+    first->prev = x;
+    x->next     = first;
+    last->next  = next;
+    if(next) next->prev = last;
+
+    uint64_t low  = x->label;
+    uint64_t high = next ? next->label : ((uint64_t)1 << OM_BITS);
+    if(high - low > m)
+    {
+        uint64_t step = (high - low) / (m + 1);
+        om_tag*  cur  = first;
+        for(size_t k = 1; k <= m; k++, cur = cur->next)
+        {
+            cur->label = low + k * step;
+        }
+        return;
+    }
+
+    om_tag* left  = x;
+    om_tag* right = last;
+    size_t  count = m + 1;
+    double  cap   = 1.0;
+    for(int i = 1; i <= OM_BITS; i++)
+    {
+        uint64_t size = (uint64_t)1 << i;
+        uint64_t base = x->label & ~(size - 1);
+        uint64_t top  = base + size - 1;
+
+        while(left->prev && left->prev->label >= base)
+        {
+            left = left->prev;
+            count++;
+        }
+        while(right->next && right->next->label <= top)
+        {
+            right = right->next;
+            count++;
+        }
+
+        cap *= 2.0 / OM_THRESHOLD;
+        if((double)count < cap)
+        {
+            uint64_t step = size / count;
+            om_tag*  cur  = left;
+            for(size_t k = 0; k < count; k++, cur = cur->next)
+            {
+                cur->label = base + k * step;
+            }
+            return;
+        }
+    }
+
+    //more tags than the label space can hold
+    abort();
+}
+
+static void _om_unlink(node* nd)
+{
+    om_tag* before = nd->open.prev;
+    om_tag* after  = nd->close.next;
+    if(before) before->next = after;
+    if(after)  after->prev  = before;
+    nd->open.prev  = NULL;
+    nd->close.next = NULL;
+}
+
+//true if a is b or one of its ancestors
+static bool _is_ancestor(node* a, node* b)
+{
+    return a->open.label <= b->open.label && b->close.label <= a->close.label;
+}
+
+//murmur3's finalizer
+static uint64_t _mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t _hash_bytes(const uint8_t* p, size_t n, uint64_t seed)
+{
+    uint64_t h = seed ^ (n * HASH_K);
+    while(n >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h ^= _mix64(word);
+        h  = ((h << 27) | (h >> 37)) * HASH_K;
+        p += 8;
+        n -= 8;
+    }
+
+    uint64_t tail = 0;
+    for(size_t k = 0; k < n; k++)
+    {
+        tail |= (uint64_t)p[k] << (8 * k);
+    }
+    return _mix64(h ^ _mix64(tail));
+}
+
+
+//the sum over the children does not depend on their order; a committed revision
+//never changes below, so whichever reader computes its hash first keeps it for everyone
+static uint64_t _hash(const view* v, node* nd)
+{
+    rev* r = _rev(v, nd);
+    if(!atomic_load_explicit(&r->hash_dirty, memory_order_acquire))
+    {
+        return atomic_load_explicit(&r->hash, memory_order_relaxed);
+    }
+
+    uint64_t hash;
+    if(nd->type == _FILE)
+    {
+        hash = _hash_bytes(_bytes(r), r->size, HASH_SEED_FILE);
+    }
+    else
+    {
+        uint64_t sum = 0;
+        for(node* cur = r->children; cur; cur = _rev(v, cur)->sibling)
+        {
+            uint64_t name = _hash_bytes((const uint8_t*)cur->name, strlen(cur->name), HASH_SEED_NAME);
+            sum += _mix64(name ^ _hash(v, cur));
+        }
+        hash = _mix64(sum ^ HASH_SEED_DIR);
+    }
+    atomic_store_explicit(&r->hash, hash, memory_order_relaxed);
+    atomic_store_explicit(&r->hash_dirty, false, memory_order_release);
+    return hash;
+}
+
+//a dirty node only has dirty ancestors, so the walk stops at the first one it meets;
+//nd and its ancestors are writable already
+static void _dirty_hash(node* nd)
+{
+    while(nd && !atomic_load_explicit(&nd->work->hash_dirty, memory_order_relaxed))
+    {
+        atomic_store_explicit(&nd->work->hash_dirty, true, memory_order_relaxed);
+        nd = nd->work->parent;
+    }
+}
+
+//a node with a single private revision, not linked anywhere yet
+static node* _create_node(const char* name, node_types type, users owner)
+{
+    node *cur = malloc(sizeof(node));
+    rev*  r   = calloc(1, sizeof(rev));
+    if(!cur || !r)
+    {
+        free(cur);
+        free(r);
+        return NULL;
+    }
+    strcpy(cur->name,name);
+    cur->id = 0;
+    cur->type = type;
+    atomic_init(&cur->cur, NULL);
+    cur->work = r;
+    cur->link = NULL;
+    cur->refs = 0;
+    cur->orphan = false;
+    cur->removed = false;
+    atomic_init(&cur->trav, 0);
+    atomic_init(&cur->trav_floor, 0);
+    cur->open.label = 0;
+    cur->open.prev = NULL;
+    cur->open.next = &cur->close;
+    cur->close.label = (uint64_t)1 << (OM_BITS - 1);
+    cur->close.prev = &cur->open;
+    cur->close.next = NULL;
+
+    r->begin = VFS_UNCOMMITTED;
+    r->tags  = 2;
+    r->owner = owner;
+    r->mode  = _default_mode(type, owner);
+    atomic_init(&r->sealed, 0);
+    atomic_init(&r->hash, 0);
+    atomic_init(&r->hash_dirty, true);
+    return cur;
+}
+
+static _Atomic uint32_t* _index_names(seq_index* index)
+{
+    return (_Atomic uint32_t*)(index->at + index->cap);
+}
+
+static void _release_index(seq_index* index)
+{
+    if(index && atomic_fetch_sub(&index->refs, 1) == 1) free(index);
+}
+
+static void _free_rev(rev* r)
+{
+    if(!r) return;
+    if(r->data && atomic_fetch_sub(&r->data->refs, 1) == 1) free(r->data);
+    _release_index(r->index);
+    free(r);
+}
+
+//free up to budget nodes of work, a chain of removed subtrees linked through link, and return
+//what is left; children are rotated in front of their parent, so no stack is needed.
+//Older revisions belong to the commits that replaced them, only the last one goes here
+static node* _free_batch(vfs_t* vfs, node* work, size_t budget)
+{
+    uint64_t freed = 0;
+    while(work && budget--)
+    {
+        node* cur = work;
+        rev*  r   = atomic_load_explicit(&cur->cur, memory_order_relaxed);
+        if(r->children)
+        {
+            node* child = r->children;
+            r->children = atomic_load_explicit(&child->cur, memory_order_relaxed)->sibling;
+            child->link = cur;
+            work = child;
+            continue;
+        }
+
+        work = cur->link;
+        _free_rev(r);
+        free(cur);
+        freed++;
+    }
+    atomic_fetch_add(&vfs->reclaimed, freed);
+    return work;
+}
+
+//free what a commit left behind, in batches that look at the abandon flag in between
+static void _free_garbage(vfs_t* vfs, garbage* g)
+{
+    while(g->revs || g->trees)
+    {
+        if(atomic_load(&vfs->reclaim_abandon)) return;
+
+        for(size_t k = 0; g->revs && k < VFS_RECLAIM_BATCH; k++)
+        {
+            rev* next = g->revs->retired;
+            _free_rev(g->revs);
+            g->revs = next;
+        }
+        if(!g->revs && g->trees) g->trees = _free_batch(vfs, g->trees, VFS_RECLAIM_BATCH);
+    }
+    atomic_fetch_sub(&vfs->reclaim_bytes, g->bytes);
+    free(g);
+}
+
+//one reclaimer thread serves every instance of the process, it is started by the
+//first big item and ends as soon as the queue runs empty
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  done;     // an item was freed or given up
+    garbage*        first;
+    garbage*        last;
+    bool            running;
+} _reclaim = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, false };
+
+static void* _reclaimer(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&_reclaim.lock);
+    while(_reclaim.first)
+    {
+        garbage* g = _reclaim.first;
+        _reclaim.first = g->next;
+        if(!_reclaim.first) _reclaim.last = NULL;
+        pthread_mutex_unlock(&_reclaim.lock);
+
+        //the owner cannot go away before its count drops
+        vfs_t* vfs = g->owner;
+        _free_garbage(vfs, g);
+
+        pthread_mutex_lock(&_reclaim.lock);
+        vfs->reclaim_queued--;
+        pthread_cond_broadcast(&_reclaim.done);
+    }
+    _reclaim.running = false;
+    pthread_mutex_unlock(&_reclaim.lock);
+    return NULL;
+}
+
+//start the reclaimer if it is not running, under _reclaim.lock
+static bool _reclaim_start(void)
+{
+    if(_reclaim.running) return true;
+
+    pthread_attr_t attr;
+    pthread_t      thread;
+    if(pthread_attr_init(&attr) != 0) return false;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    _reclaim.running = (pthread_create(&thread, &attr, _reclaimer, NULL) == 0);
+    pthread_attr_destroy(&attr);
+    return _reclaim.running;
+}
+
+//under _reclaim.lock: wait until the reclaimer is done with every item of vfs
+static void _reclaim_wait(vfs_t* vfs)
+{
+    while(vfs->reclaim_queued)
+    {
+        pthread_cond_wait(&_reclaim.done, &_reclaim.lock);
+    }
+}
+
+//a few revisions and files are freed on the spot, removed directories and
+//big batches go to the reclaimer; the items do not point into each other
+static void _dispose(vfs_t* vfs, garbage* list)
+{
+    while(list)
+    {
+        garbage* g     = list;
+        bool     small = true;
+        size_t   revs  = 0;
+        list = g->next;
+        g->next = NULL;
+
+        for(rev* r = g->revs; r && small; r = r->retired)
+        {
+            small = (++revs < VFS_RECLAIM_BATCH);
+        }
+        for(node* t = g->trees; t && small; t = t->link)
+        {
+            small = !atomic_load_explicit(&t->cur, memory_order_relaxed)->children;
+        }
+        if(small)
+        {
+            _free_garbage(vfs, g);
+            continue;
+        }
+
+        pthread_mutex_lock(&_reclaim.lock);
+        if(_reclaim_start())
+        {
+            g->owner = vfs;
+            if(_reclaim.last) _reclaim.last->next = g;
+            else              _reclaim.first      = g;
+            _reclaim.last = g;
+            vfs->reclaim_queued++;
+            g = NULL;
+        }
+        pthread_mutex_unlock(&_reclaim.lock);
+
+        //without a thread the caller pays for it
+        if(g) _free_garbage(vfs, g);
+    }
+}
+
+//under pin_lock: drop the versions nobody reads any more and
+//hand back the garbage that no remaining reader can reach
+static garbage* _collect(vfs_t* vfs)
+{
+    while(vfs->oldest != vfs->head && !vfs->oldest->readers)
+    {
+        snapshot* old = vfs->oldest;
+        vfs->oldest = old->newer;
+        free(old);
+    }
+
+    garbage*  done = NULL;
+    garbage** tail = &done;
+    while(vfs->garbage_first && vfs->garbage_first->stamp <= vfs->oldest->version)
+    {
+        *tail = vfs->garbage_first;
+        tail  = &(*tail)->next;
+        vfs->garbage_first = vfs->garbage_first->next;
+    }
+    *tail = NULL;
+    if(!vfs->garbage_first) vfs->garbage_last = NULL;
+    return done;
+}
+
+static snapshot* _pin(vfs_t* vfs)
+{
+    pthread_mutex_lock(&vfs->pin_lock);
+    snapshot* snap = vfs->head;
+    snap->readers++;
+    pthread_mutex_unlock(&vfs->pin_lock);
+    return snap;
+}
+
+//the last reader of the oldest version frees what only that version could still see
+static void _unpin(vfs_t* vfs, snapshot* snap)
+{
+    pthread_mutex_lock(&vfs->pin_lock);
+    snap->readers--;
+    garbage* done = (snap == vfs->oldest && !snap->readers) ? _collect(vfs) : NULL;
+    pthread_mutex_unlock(&vfs->pin_lock);
+    _dispose(vfs, done);
+}
+
+//what a reading call sees and what it holds while it looks
+typedef struct
+{
+    view      v;
+    snapshot* snap;     // pinned for the call
+    bool      locked;   // the write lock, held by the owner of an open transaction
+} reading;
+
+//the owner of a transaction reads its own batch, a read transaction its version,
+//everyone else the newest committed version; newest ignores read transactions
+static void _read_begin(vfs_session_t* s, reading* rd, bool newest)
+{
+    vfs_t* vfs = s->vfs;
+    rd->snap   = NULL;
+    rd->locked = false;
+
+    uint8_t txn = atomic_load(&s->txn);
+    if(txn == TXN_READ && !newest)
+    {
+        rd->v.version    = s->snap->version;
+        rd->v.perm_gen   = s->snap->perm_gen;
+        rd->v.rights_gen = s->snap->rights_gen;
+        rd->v.work       = false;
+        return;
+    }
+    if(txn == TXN_WRITE)
+    {
+        pthread_mutex_lock(&vfs->write_lock);
+        rd->locked     = true;
+        rd->v.version    = vfs->version;
+        rd->v.perm_gen   = vfs->work_gen;
+        rd->v.rights_gen = vfs->work_rights;
+        rd->v.work       = (atomic_load(&s->txn) == TXN_WRITE);
+        return;
+    }
+
+    rd->snap         = _pin(vfs);
+    rd->v.version    = rd->snap->version;
+    rd->v.perm_gen   = rd->snap->perm_gen;
+    rd->v.rights_gen = rd->snap->rights_gen;
+    rd->v.work       = false;
+}
+
+static vfs_error_t _read_end(vfs_session_t* s, reading* rd, vfs_error_t status)
+{
+    if(rd->locked) pthread_mutex_unlock(&s->vfs->write_lock);
+    if(rd->snap)   _unpin(s->vfs, rd->snap);
+    return status;
+}
+
+//the revision of n the open batch may change: copied from the committed one on first use
+//together with those of its ancestors, so every committed revision keeps its whole subtree
+//and a node with a private revision always has private ancestors
+static rev* _writable(vfs_t* vfs, node* n)
+{
+    node* cur = n;
+    while(cur && !cur->work)
+    {
+        rev* old = atomic_load_explicit(&cur->cur, memory_order_relaxed);
+        rev* cp  = malloc(sizeof(rev));
+        if(!cp) return NULL;
+
+        memcpy(cp, old, sizeof(rev));
+        cp->begin   = VFS_UNCOMMITTED;
+        cp->prev    = NULL;
+        cp->retired = NULL;
+        if(cp->data)  atomic_fetch_add(&cp->data->refs, 1);
+        if(cp->index) atomic_fetch_add(&cp->index->refs, 1);
+
+        //a sealed checksum is the longest prefix there is
+        uint64_t sealed = atomic_load_explicit(&old->sealed, memory_order_acquire);
+        if(sealed >> 32)
+        {
+            cp->crc     = (uint32_t)sealed;
+            cp->crc_len = old->size;
+        }
+        atomic_init(&cp->sealed, 0);
+        bool dirty = atomic_load_explicit(&old->hash_dirty, memory_order_acquire);
+        atomic_init(&cp->hash, atomic_load_explicit(&old->hash, memory_order_relaxed));
+        atomic_init(&cp->hash_dirty, dirty);
+
+        cur->work    = cp;
+        cur->link    = vfs->touched;
+        vfs->touched = cur;
+        cur = cp->parent;
+    }
+    return n->work;
+}
+
+//a new node joins the batch, it is freed with the batch if that is aborted
+static void _track(vfs_t* vfs, node* n)
+{
+    n->link      = vfs->touched;
+    vfs->touched = n;
+}
+
+//from and its ancestors are writable already
+static void _propagate_size(node* from, size_t old_size, size_t new_size)
+{
+    node* cur = from;
+    while(cur)
+    {
+        cur->work->size -= old_size;
+        cur->work->size += new_size;
+        cur = cur->work->parent;
+    }
+}
+
+static void _propagate_tags(node* from, size_t old_tags, size_t new_tags)
+{
+    for(node* cur = from; cur; cur = cur->work->parent)
+    {
+        cur->work->tags -= old_tags;
+        cur->work->tags += new_tags;
+    }
+}
+
+//room for one more entry in each undo log of the batch, taken before a change so that it cannot fail halfway
+static bool _room_undo(vfs_t* vfs)
+{
+    if(vfs->nundo == vfs->undo_cap)
+    {
+        size_t   cap   = vfs->undo_cap ? 2 * vfs->undo_cap : 64;
+        om_undo* grown = realloc(vfs->undo, cap * sizeof(om_undo));
+        if(!grown) return false;
+        vfs->undo     = grown;
+        vfs->undo_cap = cap;
+    }
+    if(vfs->nunlisted == vfs->unlisted_cap)
+    {
+        size_t     cap   = vfs->unlisted_cap ? 2 * vfs->unlisted_cap : 64;
+        seq_slot** grown = realloc(vfs->unlisted, cap * sizeof(seq_slot*));
+        if(!grown) return false;
+        vfs->unlisted     = grown;
+        vfs->unlisted_cap = cap;
+    }
+    return true;
+}
+
+//remember how to take back a change of the order-maintenance list
+static void _log_om(vfs_t* vfs, node* nd, om_tag* after, size_t tags)
+{
+    vfs->undo[vfs->nundo].nd    = nd;
+    vfs->undo[vfs->nundo].after = after;
+    vfs->undo[vfs->nundo].tags  = tags;
+    vfs->nundo++;
+}
+
+//is the child of slot in the directory as v sees it
+static bool _listed(const view* v, seq_slot* slot)
+{
+    uint64_t gone = atomic_load_explicit(&slot->gone, memory_order_relaxed);
+    return v->work ? gone == UINT64_MAX : gone > v->version;
+}
+
+//first slot of dir with a sequence number of at least seq, nindex if there is none
+static size_t _index_find(rev* dir, uint64_t seq)
+{
+    size_t lo = 0, hi = dir->nindex;
+    while(lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if(dir->index->at[mid].seq < seq) lo = mid + 1;
+        else                              hi = mid;
+    }
+    return lo;
+}
+
+//an empty index with room for cap slots
+static seq_index* _index_new(size_t cap)
+{
+    seq_index* fresh = malloc(sizeof(seq_index) + cap * sizeof(seq_slot) + 2 * cap * sizeof(uint32_t));
+    if(!fresh) return NULL;
+    atomic_init(&fresh->refs, 1);
+    fresh->cap  = cap;
+    fresh->used = 0;
+
+    _Atomic uint32_t* names = _index_names(fresh);
+    for(size_t k = 0; k < 2 * cap; k++)
+    {
+        atomic_init(&names[k], 0);
+    }
+    return fresh;
+}
+
+//FNV-1a of a name, the first cell to probe for it
+static size_t _name_cell(const char* name, size_t cap)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(; *name; name++)
+    {
+        h = (h ^ (uint8_t)*name) * 0x100000001b3ull;
+    }
+    return (size_t)(h ^ (h >> 32)) & (2 * cap - 1);
+}
+
+//fill slot at of index and give it a cell; readers of older revisions skip the position.
+//A child that is gone already may be freed, no revision reading index looks for it by name
+static void _index_put(seq_index* index, size_t at, uint64_t seq, node* nd, uint64_t gone)
+{
+    seq_slot* slot = &index->at[at];
+    slot->seq = seq;
+    slot->nd  = nd;
+    atomic_store_explicit(&slot->gone, gone, memory_order_relaxed);
+    if(gone != UINT64_MAX) return;
+
+    _Atomic uint32_t* names = _index_names(index);
+    size_t            cell  = _name_cell(nd->name, index->cap);
+    while(atomic_load_explicit(&names[cell], memory_order_relaxed))
+    {
+        cell = (cell + 1) & (2 * index->cap - 1);
+    }
+    atomic_store_explicit(&names[cell], (uint32_t)(at + 1), memory_order_release);
+}
+
+//room for count slots, a power of two
+static size_t _index_cap(size_t count)
+{
+    size_t cap = 16;
+    while(cap < count)
+    {
+        cap *= 2;
+    }
+    return cap;
+}
+
+//append to the index of a private revision: in place behind everything a committed
+//revision reads, otherwise into a copy with room to grow
+static bool _index_add(rev* dir, uint64_t seq, node* nd)
+{
+    seq_index* index  = dir->index;
+    bool       shared = index && atomic_load(&index->refs) > 1;
+    if(!index || dir->nindex == index->cap || (shared && dir->nindex != index->used))
+    {
+        seq_index* fresh = _index_new(_index_cap(2 * dir->nindex));
+        if(!fresh) return false;
+        for(size_t k = 0; k < dir->nindex; k++)
+        {
+            _index_put(fresh, k, index->at[k].seq, index->at[k].nd,
+                       atomic_load_explicit(&index->at[k].gone, memory_order_relaxed));
+        }
+        _release_index(index);
+        dir->index = index = fresh;
+    }
+
+    _index_put(index, dir->nindex++, seq, nd, UINT64_MAX);
+    index->used = dir->nindex;
+    return true;
+}
+
+//once half the slots are unlinked children, a fresh index holds just the linked ones;
+//revisions that still read the old one keep it
+static void _index_compact(rev* dir)
+{
+    size_t     count = dir->nindex - dir->ndead;
+    seq_index* fresh = _index_new(_index_cap(2 * count));
+    if(!fresh) return;
+    fresh->used = count;
+
+    //the list runs by falling sequence number
+    size_t at = count;
+    for(node* cur = dir->children; cur; cur = _newest(cur)->sibling)
+    {
+        _index_put(fresh, --at, _newest(cur)->seq, cur, UINT64_MAX);
+    }
+    _release_index(dir->index);
+    dir->index  = fresh;
+    dir->nindex = count;
+    dir->ndead  = 0;
+}
+
+static bool _add_child(vfs_t* vfs, node* parent, node* child)
+{
+    rev* p = _writable(vfs, parent);
+    rev* c = _writable(vfs, child);
+    if(!p || !c || !_room_undo(vfs) || !_index_add(p, p->next_seq + 1, child)) return false;
+    _log_om(vfs, child, NULL, 0);
+
+    c->parent = parent;
+    c->sibling = p->children;
+    p->children = child;
+    c->seq = ++p->next_seq;
+    _dirty_hash(parent);
+
+    //a new first child comes right after the parent in the tour
+    _om_insert_after(&parent->open, &child->open, &child->close, c->tags);
+    _propagate_tags(parent, 0, c->tags);
+    _propagate_size(parent, 0, c->size);
+    return true;
+}
+
+//take nd out of the list of its parent; the one before it in the list, the closest
+//linked child with a larger sequence number, gets a revision of its own
+static bool _unlink_child(vfs_t* vfs, node* parent, node* nd)
+{
+    rev* p = _writable(vfs, parent);
+    rev* r = _writable(vfs, nd);
+    if(!p || !r || !_room_undo(vfs)) return false;
+
+    size_t    at   = _index_find(p, r->seq);
+    seq_slot* slot = &p->index->at[at];
+    rev*      before = NULL;
+    for(size_t k = at + 1; k < p->nindex && !before; k++)
+    {
+        if(atomic_load_explicit(&p->index->at[k].gone, memory_order_relaxed) != UINT64_MAX) continue;
+        before = _writable(vfs, p->index->at[k].nd);
+        if(!before) return false;
+    }
+    _log_om(vfs, nd, nd->open.prev, r->tags);
+
+    if(before) before->sibling = r->sibling;
+    else       p->children     = r->sibling;
+
+    //older versions still list it; the slot is theirs too as long as the committed revision reads it
+    rev* committed = atomic_load_explicit(&parent->cur, memory_order_relaxed);
+    if(committed && committed->index == p->index) vfs->unlisted[vfs->nunlisted++] = slot;
+    atomic_store_explicit(&slot->gone, vfs->version + 1, memory_order_relaxed);
+    if(++p->ndead > 32 && 2 * p->ndead > p->nindex) _index_compact(p);
+
+    r->parent  = NULL;
+    r->sibling = NULL;
+
+    _om_unlink(nd);
+    _propagate_tags(parent, r->tags, 0);
+    _propagate_size(parent, r->size, 0);
+    _dirty_hash(parent);
+    return true;
+}
+
+//true if nd lies in a subtree the batch removes, nd and its ancestors as the writer sees them
+static bool _in_removed(node* nd)
+{
+    for(node* cur = nd; cur; cur = _newest(cur)->parent)
+    {
+        if(cur->removed) return true;
+    }
+    return false;
+}
+
+//does the watch care about nd, whose parent is parent in the newest tree
+static bool _matches(const watch_ref* ref, node* nd, node* parent)
+{
+    return nd == ref->target || parent == ref->target || (ref->recursive && _is_ancestor(ref->target, nd));
+}
+
+//under the write lock, writer side of the queue
+static void _stage(vfs_t* vfs, watch* w, event_types type, uint64_t id)
+{
+    if(!w->in_batch)
+    {
+        w->in_batch    = true;
+        w->staged_next = vfs->staged;
+        vfs->staged    = w;
+    }
+    if(w->staged - atomic_load_explicit(&w->tail, memory_order_acquire) >= VFS_WATCH_QUEUE)
+    {
+        w->staged_lost++;
+        return;
+    }
+    w->events[w->staged % VFS_WATCH_QUEUE] = (vfs_event_t){ type, id };
+    w->staged++;
+}
+
+//events wait for the commit of their batch
+static void _notify(vfs_t* vfs, event_types type, node* nd)
+{
+    if(!vfs->nwatching || nd->orphan) return;
+
+    node* parent = _newest(nd)->parent;
+    for(size_t k = 0; k < vfs->nwatching; k++)
+    {
+        watch_ref* ref = &vfs->watching[k];
+        if(!ref->target) continue;
+
+        if(_matches(ref, nd, parent) || (type == _MOVED && ref->w->marked == vfs->moves))
+        {
+            _stage(vfs, ref->w, type, nd->id);
+        }
+        //a watch below a removed node hears about the end of its own node
+        else if(type == _DELETED && _is_ancestor(nd, ref->target) && !_in_removed(ref->target))
+        {
+            _stage(vfs, ref->w, _DELETED, ref->target->id);
+        }
+    }
+}
+
+//a move is told to the watches of the old place as well; they are marked before it
+static void _mark_move(vfs_t* vfs, node* nd)
+{
+    vfs->moves++;
+    if(!vfs->nwatching) return;
+
+    node* parent = _newest(nd)->parent;
+    for(size_t k = 0; k < vfs->nwatching; k++)
+    {
+        watch_ref* ref = &vfs->watching[k];
+        if(ref->target && _matches(ref, nd, parent)) ref->w->marked = vfs->moves;
+    }
+}
+
+//the events of the batch become readable, or are dropped with it
+static void _publish(vfs_t* vfs, bool keep)
+{
+    for(watch* w = vfs->staged; w; w = w->staged_next)
+    {
+        if(keep)
+        {
+            if(w->staged_lost) atomic_fetch_add_explicit(&w->lost, w->staged_lost, memory_order_relaxed);
+            atomic_store_explicit(&w->head, w->staged, memory_order_release);
+        }
+        else
+        {
+            w->staged = atomic_load_explicit(&w->head, memory_order_relaxed);
+        }
+        w->staged_lost = 0;
+        w->in_batch    = false;
+    }
+    vfs->staged = NULL;
+}
+
+//watches whose node is gone end, gone(nd) tells which nodes are
+static void _end_watches(vfs_t* vfs, bool (*gone)(node*))
+{
+    for(size_t k = 0; k < vfs->nwatching; k++)
+    {
+        watch_ref* ref = &vfs->watching[k];
+        if(ref->target && gone(ref->target)) ref->target = NULL;
+    }
+}
+
+//under the write lock; events it staged in the open batch go with it
+static void _unlist_watch(vfs_t* vfs, watch* w)
+{
+    watch_ref* last = &vfs->watching[--vfs->nwatching];
+    vfs->watching[w->ref] = *last;
+    last->w->ref          = w->ref;
+
+    for(watch** link = &vfs->staged; w->in_batch && *link; link = &(*link)->staged_next)
+    {
+        if(*link != w) continue;
+        *link = w->staged_next;
+        break;
+    }
+}
+
+//an open file of a removed subtree goes on as a node of its own, so the subtree is
+//freed like any other while the handles keep reading and writing the copy
+static node* _orphan_copy(vfs_t* vfs, node* file)
+{
+    node* cp = _create_node(file->name, _FILE, _CASUAL);
+    if(!cp) return NULL;
+
+    rev* src = _newest(file);
+    rev* r   = cp->work;
+    memcpy(r, src, sizeof(rev));
+    r->begin    = 0;
+    r->prev     = NULL;
+    r->retired  = NULL;
+    r->parent   = NULL;
+    r->sibling  = NULL;
+    if(r->data) atomic_fetch_add(&r->data->refs, 1);
+    atomic_init(&r->sealed, atomic_load(&src->sealed));
+    atomic_init(&r->hash, atomic_load(&src->hash));
+    atomic_init(&r->hash_dirty, atomic_load(&src->hash_dirty));
+
+    cp->id     = file->id;
+    cp->work   = NULL;
+    cp->orphan = true;
+    atomic_store(&cp->cur, r);
+
+    for(vfs_session_t* s = vfs->sessions; s; s = s->next)
+    {
+        for(int fd = 0; fd < s->nhandles; fd++)
+        {
+            if(s->handles[fd].file != file) continue;
+            s->handles[fd].file = cp;
+            cp->refs++;
+        }
+    }
+    file->refs = 0;
+    return cp;
+}
+
+//what removed subtrees take along: open files become orphans, sessions inside
+//go back to the root and watches on them end; returns the bytes of the orphans
+static size_t _release_removed(vfs_t* vfs)
+{
+    size_t bytes = 0;
+    for(vfs_session_t* s = vfs->sessions; s; s = s->next)
+    {
+        if(atomic_load(&s->txn) != TXN_READ && _in_removed(atomic_load(&s->cwd)))
+        {
+            atomic_store(&s->cwd, vfs->root);
+        }
+        for(int fd = 0; fd < s->nhandles; fd++)
+        {
+            node* file = s->handles[fd].file;
+            if(!file || file->orphan || !_in_removed(file)) continue;
+
+            bytes += _newest(file)->size;
+            if(!_orphan_copy(vfs, file)) s->handles[fd].file = NULL;
+        }
+    }
+
+    _end_watches(vfs, _in_removed);
+    return bytes;
+}
+
+static void _reset_batch(vfs_t* vfs)
+{
+    vfs->touched   = NULL;
+    vfs->nremoved  = 0;
+    vfs->nundo     = 0;
+    vfs->nunlisted = 0;
+}
+
+//a node the open batch created and no commit published yet
+static bool _uncommitted(node* nd)
+{
+    return !atomic_load(&nd->cur);
+}
+
+//drop every change of the open batch
+static void _abort_batch(vfs_t* vfs)
+{
+    //the order-maintenance list goes back to where the batch found it
+    while(vfs->nundo)
+    {
+        om_undo* u = &vfs->undo[--vfs->nundo];
+        if(u->after) _om_insert_after(u->after, &u->nd->open, &u->nd->close, u->tags);
+        else         _om_unlink(u->nd);
+    }
+    while(vfs->nunlisted)
+    {
+        atomic_store_explicit(&vfs->unlisted[--vfs->nunlisted]->gone, UINT64_MAX, memory_order_relaxed);
+    }
+
+    //nodes created by the batch go away, unless a handle still has them
+    vfs_session_t* owner = vfs->txn_owner;
+    if(owner && _uncommitted(atomic_load(&owner->cwd))) atomic_store(&owner->cwd, vfs->root);
+    _end_watches(vfs, _uncommitted);
+    _publish(vfs, false);
+
+    node* next;
+    for(node* n = vfs->touched; n; n = next)
+    {
+        next    = n->link;
+        rev* w  = n->work;
+        n->link = NULL;
+        n->work = NULL;
+
+        rev* old = atomic_load_explicit(&n->cur, memory_order_relaxed);
+        if(old && !(n->orphan && !n->refs))
+        {
+            _free_rev(w);
+            continue;
+        }
+        if(!old && n->refs)
+        {
+            w->begin   = 0;
+            w->parent  = NULL;
+            w->sibling = NULL;
+            n->orphan  = true;
+            atomic_store(&n->cur, w);
+            continue;
+        }
+        _free_rev(w);
+        _free_rev(old);
+        free(n);
+    }
+
+    _reset_batch(vfs);
+
+    //moves of the batch left their generation on the nodes they moved; the next
+    //batch gets a newer one so that those nodes trust their caches again once it commits
+    vfs->work_rights = vfs->head->rights_gen;
+    if(vfs->work_gen != vfs->head->perm_gen) vfs->work_gen = ++vfs->perm_gen;
+}
+
+//publish the open batch as the next version; its old revisions and removed
+//subtrees are freed once every reader has moved past it
+static vfs_error_t _commit_batch(vfs_t* vfs)
+{
+    if(!vfs->touched)
+    {
+        _reset_batch(vfs);
+        return _OK;
+    }
+
+    snapshot* snap = malloc(sizeof(snapshot));
+    garbage*  g    = calloc(1, sizeof(garbage));
+    if(!snap || !g)
+    {
+        free(snap);
+        free(g);
+        _abort_batch(vfs);
+        return _INVALID_ARGUMENTS;
+    }
+
+    uint64_t version = vfs->version + 1;
+    if(vfs->nremoved)
+    {
+        for(size_t k = 0; k < vfs->nremoved; k++)
+        {
+            node* gone = vfs->removed[k];
+            gone->removed = true;
+            g->bytes += _newest(gone)->size;
+        }
+        g->bytes -= _release_removed(vfs);
+    }
+
+    node* next;
+    for(node* n = vfs->touched; n; n = next)
+    {
+        next    = n->link;
+        rev* w  = n->work;
+        n->link = NULL;
+        n->work = NULL;
+
+        rev* old = atomic_load_explicit(&n->cur, memory_order_relaxed);
+
+        //an orphan whose last handle was closed during the batch
+        if(n->orphan && !n->refs)
+        {
+            _free_rev(w);
+            _free_rev(old);
+            free(n);
+            continue;
+        }
+
+        w->begin = version;
+        w->prev  = old;
+        if(old)
+        {
+            old->retired = g->revs;
+            g->revs      = old;
+        }
+        atomic_store_explicit(&n->cur, w, memory_order_release);
+    }
+
+    for(size_t k = 0; k < vfs->nremoved; k++)
+    {
+        vfs->removed[k]->link = g->trees;
+        g->trees = vfs->removed[k];
+    }
+    atomic_fetch_add(&vfs->reclaim_bytes, g->bytes);
+    g->stamp = version;
+
+    snap->version  = version;
+    snap->perm_gen   = vfs->work_gen;
+    snap->rights_gen = vfs->work_rights;
+    snap->readers  = 0;
+    snap->newer    = NULL;
+
+    pthread_mutex_lock(&vfs->pin_lock);
+    vfs->head->newer = snap;
+    vfs->head        = snap;
+    vfs->version     = version;
+    if(g->revs || g->trees)
+    {
+        if(vfs->garbage_last) vfs->garbage_last->next = g;
+        else                  vfs->garbage_first      = g;
+        vfs->garbage_last = g;
+        g = NULL;
+    }
+    garbage* done = _collect(vfs);
+    pthread_mutex_unlock(&vfs->pin_lock);
+    free(g);
+
+    //the batch becomes visible to watchers all at once
+    _publish(vfs, true);
+    _reset_batch(vfs);
+    _dispose(vfs, done);
+    return _OK;
+}
+
+//under write_lock: writers take turns, a transaction of another session is waited for
+//until its commit or abort instead of being broken into
+static void _wait_txn(vfs_session_t* s)
+{
+    vfs_t* vfs = s->vfs;
+    while(vfs->txn_owner && vfs->txn_owner != s)
+    {
+        pthread_cond_wait(&vfs->txn_done, &vfs->write_lock);
+    }
+}
+
+//under write_lock: the open transaction is over, the next writer may go
+static void _end_txn(vfs_t* vfs)
+{
+    vfs->txn_owner = NULL;
+    pthread_cond_broadcast(&vfs->txn_done);
+}
+
+//a writing call takes the write lock and works on the open batch of its session,
+//or on a batch of its own that _write_end commits
+static vfs_error_t _write_begin(vfs_session_t* s, view* v)
+{
+    vfs_t* vfs = s->vfs;
+    if(atomic_load(&s->txn) == TXN_READ) return _PERMISSION_DENIED;
+
+    pthread_mutex_lock(&vfs->write_lock);
+    _wait_txn(s);
+
+    v->version    = vfs->version;
+    v->perm_gen   = vfs->work_gen;
+    v->rights_gen = vfs->work_rights;
+    v->work       = true;
+    return _OK;
+}
+
+static vfs_error_t _write_end(vfs_session_t* s, vfs_error_t status)
+{
+    vfs_t* vfs = s->vfs;
+    if(vfs->txn_owner != s)
+    {
+        if(status == _OK) status = _commit_batch(vfs);
+        else              _abort_batch(vfs);
+    }
+    pthread_mutex_unlock(&vfs->write_lock);
+    return status;
+}
+
+//room for one more removed subtree, taken before the unlink so that it cannot fail after
+static bool _room_removed(vfs_t* vfs)
+{
+    if(vfs->nremoved < vfs->removed_cap) return true;
+
+    size_t cap   = vfs->removed_cap ? 2 * vfs->removed_cap : 16;
+    node** grown = realloc(vfs->removed, cap * sizeof(node*));
+    if(!grown) return false;
+    vfs->removed     = grown;
+    vfs->removed_cap = cap;
+    return true;
+}
+
+//a change of traversal rights gives the batch a generation of its own that no
+//cached mask of an older generation holds in
+static void _perm_changed(vfs_t* vfs)
+{
+    vfs->work_gen    = ++vfs->perm_gen;
+    vfs->work_rights = vfs->work_gen;
+}
+
+//after a move only the moved subtree has new ancestors: the batch gets a generation of its
+//own and only the directories below top stop trusting masks cached under older ones. The
+//walk follows the tags the move has just relabelled: after an open tag comes the node's own
+//close tag or its first child, after a close tag the next sibling or the parent's close tag.
+//A subtree too big to walk drops every cached mask instead, each is rebuilt once
+static void _ancestors_changed(vfs_t* vfs, node* top)
+{
+    if(_newest(top)->tags > SCOPED_MOVE_TAGS)
+    {
+        _perm_changed(vfs);
+        return;
+    }
+    uint64_t gen  = ++vfs->perm_gen;
+    vfs->work_gen = gen;
+
+    node* nd   = top;
+    bool  open = true;
+    while(true)
+    {
+        if(open)
+        {
+            if(nd->type == _DIR) atomic_store_explicit(&nd->trav_floor, gen, memory_order_relaxed);
+            om_tag* next = nd->open.next;
+            if(next == &nd->close) open = false;
+            else                   nd   = (node*)((char*)next - offsetof(node, open));
+            continue;
+        }
+        if(nd == top) break;
+
+        node*   parent = _newest(nd)->parent;
+        om_tag* next   = nd->close.next;
+        if(next == &parent->close)
+        {
+            nd = parent;
+        }
+        else
+        {
+            nd   = (node*)((char*)next - offsetof(node, open));
+            open = true;
+        }
+    }
+}
+
+//make room for need bytes in the blob of a private revision, which keeps its first keep bytes.
+//A blob shared with other revisions is only written where none of them reads: behind
+//everything ever written to it, the common case of an append. Anything else gets a copy
+static bool _reserve(rev* file, size_t offset, size_t need, size_t keep, const uint8_t* content)
+{
+    //doubling past half the address space would wrap
+    if(need >= SIZE_MAX / 2) return false;
+
+    blob* b      = file->data;
+    bool  shared = b && atomic_load(&b->refs) > 1;
+    if(b && need <= b->cap && (!shared || (offset >= b->used && keep == b->used))) return true;
+
+    size_t cap = (b && b->cap) ? b->cap : 16;
+    while(cap < need)
+    {
+        cap *= 2;
+    }
+
+    //content may point into this very blob (print! a | insert >> a), then the
+    //new blob has to be filled before the old one goes away
+    uintptr_t from    = (uintptr_t)content;
+    bool      aliased = b && from >= (uintptr_t)b->bytes && from < (uintptr_t)b->bytes + b->cap;
+    if(b && !shared && !aliased)
+    {
+        blob* grown = realloc(b, sizeof(blob) + cap);
+        if(!grown) return false;
+        grown->cap = cap;
+        file->data = grown;
+        return true;
+    }
+
+    blob* fresh = malloc(sizeof(blob) + cap);
+    if(!fresh) return false;
+    atomic_init(&fresh->refs, 1);
+    fresh->cap  = cap;
+    fresh->used = 0;
+    if(keep) memcpy(fresh->bytes, b->bytes, keep);
+    file->data = fresh;
+
+    //the old blob is released by the caller once content is copied
+    return true;
+}
+
+//write len bytes at offset into a private revision, zero filling a gap behind its end;
+//truncate drops the old contents first
+static bool _write_bytes(rev* file, size_t offset, const uint8_t* content, size_t len, bool truncate)
+{
+    size_t keep     = truncate ? 0 : file->size;
+    size_t end      = offset + len;
+    size_t new_size = (end > keep) ? end : keep;
+    if(!new_size && !file->data) return true;
+
+    blob* old = file->data;
+    if(!_reserve(file, offset, new_size, keep, content)) return false;
+
+    blob* b = file->data;
+    if(offset > keep) memset(b->bytes + keep, 0, offset - keep);
+    if(len) memmove(b->bytes + offset, content, len);
+    b->used    = new_size;
+    file->size = new_size;
+
+    if(old && old != b && atomic_fetch_sub(&old->refs, 1) == 1) free(old);
+    return true;
+}
+
+//after a write of len bytes at offset of a file that had old_size bytes: bytes right behind
+//the checksummed prefix extend it, a zero filled gap before them included. A change inside
+//the prefix drops it, unless it starts at 0 and so becomes the new prefix itself
+static void _update_crc(rev* file, size_t offset, size_t len, size_t old_size)
+{
+    uint64_t sealed = atomic_load_explicit(&file->sealed, memory_order_relaxed);
+    if(sealed >> 32)
+    {
+        file->crc     = (uint32_t)sealed;
+        file->crc_len = old_size;
+    }
+    atomic_store_explicit(&file->sealed, 0, memory_order_relaxed);
+
+    if(offset < file->crc_len)
+    {
+        file->crc     = 0;
+        file->crc_len = 0;
+    }
+    if(file->crc_len == offset || (file->crc_len == old_size && offset > old_size))
+    {
+        file->crc     = _crc32c(file->crc, _bytes(file) + file->crc_len, offset + len - file->crc_len);
+        file->crc_len = offset + len;
+    }
+}
+
+//the prefix of a committed revision never changes, the rest is sealed once for every reader
+static uint32_t _checksum(rev* file)
+{
+    uint64_t sealed = atomic_load_explicit(&file->sealed, memory_order_acquire);
+    if(sealed >> 32) return (uint32_t)sealed;
+
+    uint32_t crc = file->crc;
+    if(file->crc_len < file->size)
+    {
+        crc = _crc32c(crc, _bytes(file) + file->crc_len, file->size - file->crc_len);
+    }
+    atomic_store_explicit(&file->sealed, (uint64_t)1 << 32 | crc, memory_order_release);
+    return crc;
+}
+
+//a short list is walked, a longer one found by name hash; the cells of a position added
+//after the revision of dir, or of a child that is gone in v, are passed over
+static node* _find_child(const view* v, const char* name, node* parent)
+{
+    if(!parent) return NULL;
+    rev* dir = _rev(v, parent);
+    if(dir->nindex <= NAME_SCAN)
+    {
+        for(node* cur = dir->children; cur; cur = _rev(v, cur)->sibling)
+        {
+            if(strcmp(cur->name, name) == 0) return cur;
+        }
+        return NULL;
+    }
+
+    seq_index*        index = dir->index;
+    _Atomic uint32_t* names = _index_names(index);
+    for(size_t cell = _name_cell(name, index->cap); ; cell = (cell + 1) & (2 * index->cap - 1))
+    {
+        uint32_t at = atomic_load_explicit(&names[cell], memory_order_acquire);
+        if(!at) return NULL;
+        if(at > dir->nindex) continue;
+
+        seq_slot* slot = &index->at[at - 1];
+        if(_listed(v, slot) && strcmp(slot->nd->name, name) == 0) return slot->nd;
+    }
+}
+
+//resolve a name in the current directory or an absolute path,
+//every directory passed on the way has to be traversable
+static vfs_error_t _lookup(vfs_session_t* s, const view* v, const char* path, node** out)
+{
+    if(!path || path[0] == '\0') return _INVALID_ARGUMENTS;
+
+    node* cur;
+    if(!strchr(path,'/'))
+    {
+        node* cwd = atomic_load(&s->cwd);
+        if(!_can_traverse(s, v, cwd)) return _PERMISSION_DENIED;
+        cur = _find_child(v, path, cwd);
+        if(!cur) return _NOT_FOUND;
+        *out = cur;
+        return _OK;
+    }
+
+    if(path[0] != '/') return _NOT_FOUND;
+
+    char* path_copy = strdup(path);
+    if(!path_copy) return _INVALID_ARGUMENTS;
+
+    char *save_pointer;
+    cur = s->vfs->root;
+
+    char* token = strtok_r(path_copy,"/",&save_pointer);
+    while(token)
+    {
+        if(cur->type != _DIR)
+        {
+            free(path_copy);
+            return _NOT_A_DIRECTORY;
+        }
+        if(!_can_traverse(s, v, cur))
+        {
+            free(path_copy);
+            return _PERMISSION_DENIED;
+        }
+        cur = _find_child(v, token,cur);
+        if(!cur)
+        {
+            free(path_copy);
+            return _NOT_FOUND;
+        }
+        token = strtok_r(NULL,"/",&save_pointer);
+    }
+
+    free(path_copy);
+    *out = cur;
+    return _OK;
+}
+
+static char* _get_absolute_path(const view* v, node* cwd)
+{
+    if (!cwd) return NULL;
+
+    //measure first, then fill in the names from the end, so any depth works
+    size_t total_len = 0;
+    for (node* cur = cwd; _rev(v, cur)->parent; cur = _rev(v, cur)->parent)
+    {
+        total_len += strlen(cur->name) + 1;
+    }
+    if (total_len == 0) return strdup("/");
+
+    char* path = malloc(total_len + 1);
+    if (!path) return NULL;
+
+    path[total_len] = '\0';
+    size_t at = total_len;
+    for (node* cur = cwd; _rev(v, cur)->parent; cur = _rev(v, cur)->parent)
+    {
+        size_t len = strlen(cur->name);
+        at -= len;
+        memcpy(path + at, cur->name, len);
+        path[--at] = '/';
+    }
+    return path;
+}
+
+//nd is still reachable from the root in the newest tree
+static bool _is_linked(vfs_t* vfs, node* nd)
+{
+    node* cur = nd;
+    while(_newest(cur)->parent)
+    {
+        cur = _newest(cur)->parent;
+    }
+    return cur == vfs->root;
+}
+
+//true if some session works inside the subtree of nd
+static bool _is_session_dir(vfs_t* vfs, node* nd)
+{
+    vfs_session_t* cur = vfs->sessions;
+    while(cur)
+    {
+        //a read transaction may sit in a removed subtree, whose labels are stale
+        node* cwd = atomic_load(&cur->cwd);
+        if(cwd == nd || (_is_linked(vfs, cwd) && _is_ancestor(nd, cwd))) return true;
+        cur = cur->next;
+    }
+    return false;
+}
+
+//the view of s under the write lock: its transaction, its read transaction or the newest version;
+//newest ignores read transactions
+static void _locked_view(vfs_session_t* s, view* v, bool newest)
+{
+    vfs_t*  vfs = s->vfs;
+    uint8_t txn = atomic_load(&s->txn);
+    if(txn == TXN_READ && !newest)
+    {
+        v->version    = s->snap->version;
+        v->perm_gen   = s->snap->perm_gen;
+        v->rights_gen = s->snap->rights_gen;
+        v->work       = false;
+        return;
+    }
+    v->version    = vfs->version;
+    v->work       = (txn == TXN_WRITE);
+    v->perm_gen   = v->work ? vfs->work_gen : vfs->head->perm_gen;
+    v->rights_gen = v->work ? vfs->work_rights : vfs->head->rights_gen;
+}
+
+static vfs_error_t _check_name(const char* name)
+{
+    if(strlen(name) >= 32)
+    {
+        return _TOO_LONG;
+    }
+
+    if (name[0] == '\0' || strcmp(name,".")==0 || strcmp(name,"..")==0)
+        return _ILLEGAL_CHARACTER;
+
+    for (int i = 0; name[i]; i++)
+    {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') ||
+              (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') ||
+               c == '_' || c == '-'  || c == '.'))
+            {
+                return _ILLEGAL_CHARACTER;
+            }
+    }
+    return _OK;
+}
+
+//instances and sessions
+vfs_t* vfs_create(void)
+{
+    vfs_t* vfs = calloc(1, sizeof(vfs_t));
+    if(!vfs) return NULL;
+    pthread_once(&_crc_once, _crc_init);
+    pthread_mutex_init(&vfs->write_lock, NULL);
+    pthread_cond_init(&vfs->txn_done, NULL);
+    pthread_mutex_init(&vfs->pin_lock, NULL);
+
+    vfs->root = _create_node("/",_DIR,_CASUAL);
+    vfs->head = calloc(1, sizeof(snapshot));
+    if(!vfs->root || !vfs->head)
+    {
+        if(vfs->root) _free_rev(vfs->root->work);
+        free(vfs->root);
+        free(vfs->head);
+        free(vfs);
+        return NULL;
+    }
+
+    //the empty tree is version 0
+    vfs->root->work->begin = 0;
+    atomic_store(&vfs->root->cur, vfs->root->work);
+    vfs->root->work = NULL;
+
+    vfs->perm_gen         = 1;
+    vfs->work_gen         = 1;
+    vfs->work_rights      = 1;
+    vfs->head->perm_gen   = 1;
+    vfs->head->rights_gen = 1;
+    vfs->oldest         = vfs->head;
+    vfs->root->id = ++vfs->next_id;
+    strcpy(vfs->pass, "helloworld");
+    return vfs;
+}
+
+void vfs_destroy(vfs_t* vfs)
+{
+    if(!vfs) return;
+
+    while(vfs->sessions)
+    {
+        vfs_session_close(vfs->sessions);
+    }
+
+    //let the reclaimer free what is queued for this instance before it goes away
+    pthread_mutex_lock(&_reclaim.lock);
+    _reclaim_wait(vfs);
+    pthread_mutex_unlock(&_reclaim.lock);
+
+    //without sessions nobody reads an old version any more
+    garbage* next;
+    for(garbage* g = vfs->garbage_first; g; g = next)
+    {
+        next = g->next;
+        _free_garbage(vfs, g);
+    }
+    snapshot* newer;
+    for(snapshot* snap = vfs->oldest; snap; snap = newer)
+    {
+        newer = snap->newer;
+        free(snap);
+    }
+
+    vfs->root->link = NULL;
+    _free_batch(vfs, vfs->root, SIZE_MAX);
+    pthread_mutex_destroy(&vfs->write_lock);
+    pthread_cond_destroy(&vfs->txn_done);
+    pthread_mutex_destroy(&vfs->pin_lock);
+    free(vfs->watching);
+    free(vfs->undo);
+    free(vfs->unlisted);
+    free(vfs->removed);
+    free(vfs);
+}
+
+void vfs_abandon(vfs_t* vfs)
+{
+    if(!vfs) return;
+
+    //the item being freed stops after its batch, the queued ones are left as they are
+    atomic_store(&vfs->reclaim_abandon, true);
+    pthread_mutex_lock(&_reclaim.lock);
+    garbage* prev = NULL;
+    for(garbage* g = _reclaim.first; g; g = g->next)
+    {
+        if(g->owner != vfs)
+        {
+            prev = g;
+            continue;
+        }
+        if(prev) prev->next     = g->next;
+        else     _reclaim.first = g->next;
+        if(_reclaim.last == g) _reclaim.last = prev;
+        vfs->reclaim_queued--;
+    }
+    _reclaim_wait(vfs);
+    pthread_mutex_unlock(&_reclaim.lock);
+}
+
+void vfs_stats(vfs_t* vfs, vfs_stats_t* out)
+{
+    if(!vfs || !out) return;
+    out->reclaim_bytes = atomic_load(&vfs->reclaim_bytes);
+    out->reclaimed     = atomic_load(&vfs->reclaimed);
+}
+
+vfs_session_t* vfs_session_open(vfs_t* vfs)
+{
+    if(!vfs) return NULL;
+
+    vfs_session_t* s = malloc(sizeof(vfs_session_t));
+    if(!s) return NULL;
+
+    s->vfs  = vfs;
+    atomic_init(&s->cwd, vfs->root);
+    s->user = _CASUAL;
+    s->handles  = NULL;
+    s->nhandles = 0;
+    s->watches  = NULL;
+    s->nwatches = 0;
+    atomic_init(&s->txn, TXN_NONE);
+    s->snap = NULL;
+
+    pthread_mutex_lock(&vfs->write_lock);
+    s->next = vfs->sessions;
+    vfs->sessions = s;
+    pthread_mutex_unlock(&vfs->write_lock);
+    return s;
+}
+
+//under the write lock; an orphan goes away with its last handle
+static void _close_handle(vfs_handle* h)
+{
+    node* file = h->file;
+    h->file = NULL;
+
+    file->refs--;
+    if(file->refs || !file->orphan || file->work) return;
+    _free_rev(atomic_load(&file->cur));
+    free(file);
+}
+
+void vfs_session_close(vfs_session_t* s)
+{
+    if(!s) return;
+
+    vfs_t* vfs = s->vfs;
+    if(atomic_load(&s->txn) != TXN_NONE) vfs_abort(s);
+
+    pthread_mutex_lock(&vfs->write_lock);
+    for(int fd = 0; fd < s->nhandles; fd++)
+    {
+        if(s->handles[fd].file) _close_handle(&s->handles[fd]);
+    }
+    free(s->handles);
+
+    for(int wd = 0; wd < s->nwatches; wd++)
+    {
+        if(!s->watches[wd]) continue;
+        _unlist_watch(vfs, s->watches[wd]);
+        free(s->watches[wd]);
+    }
+    free(s->watches);
+
+    vfs_session_t** link = &vfs->sessions;
+    while(*link && *link != s)
+    {
+        link = &(*link)->next;
+    }
+    if(*link) *link = s->next;
+    pthread_mutex_unlock(&vfs->write_lock);
+    free(s);
+}
+
+users vfs_session_user(const vfs_session_t* s)
+{
+    return s->user;
+}
+
+bool vfs_in_transaction(const vfs_session_t* s)
+{
+    return atomic_load(&s->txn) != TXN_NONE;
+}
+
+char* vfs_getcwd(vfs_session_t* s)
+{
+    reading rd;
+    _read_begin(s, &rd, false);
+    char* path = _get_absolute_path(&rd.v, atomic_load(&s->cwd));
+    _read_end(s, &rd, _OK);
+    return path;
+}
+
+//commands
+vfs_error_t vfs_ls(vfs_session_t* s, vfs_ls_cb cb, void* ctx)
+{
+    uint64_t next;
+    return vfs_ls_page(s, 0, 0, true, cb, ctx, &next);
+}
+
+//the listed child in the slots of dir below at, at moves on to its slot
+static node* _index_below(const view* v, rev* dir, size_t* at)
+{
+    while(*at)
+    {
+        seq_slot* slot = &dir->index->at[--*at];
+        if(_listed(v, slot)) return slot->nd;
+    }
+    return NULL;
+}
+
+vfs_error_t vfs_ls_page(vfs_session_t* s, uint64_t cursor, size_t limit, bool sizes,
+                        vfs_ls_cb cb, void* ctx, uint64_t* next)
+{
+    if(!cb || !next) return _INVALID_ARGUMENTS;
+
+    reading rd;
+    _read_begin(s, &rd, false);
+    //the working directory, or one above it, may have lost its x bit since the cd
+    node* cwd = atomic_load(&s->cwd);
+    rev*  dir = _rev(&rd.v, cwd);
+    if(!_can_traverse(s, &rd.v, cwd) || !_is_allowed(dir, s->user, VFS_R))
+    {
+        return _read_end(s, &rd, _PERMISSION_DENIED);
+    }
+
+    //children are kept newest first, so the list is ordered by falling seq;
+    //a cursor is looked up in the index and the listing goes on from there
+    size_t at  = cursor ? _index_find(dir, cursor) : 0;
+    node*  cur = cursor ? _index_below(&rd.v, dir, &at) : dir->children;
+
+    size_t count = 0;
+    *next = 0;
+    while(cur)
+    {
+        rev* r = _rev(&rd.v, cur);
+        if(limit && count == limit)
+        {
+            *next = r->seq + 1;
+            break;
+        }
+
+        vfs_entry_t entry;
+        entry.name    = cur->name;
+        entry.id      = cur->id;
+        entry.type    = cur->type;
+        entry.size    = sizes ? r->size : 0;
+        entry.owner   = r->owner;
+        entry.mode    = r->mode;
+
+        if(cb(&entry, ctx)) break;
+        count++;
+        cur = cursor ? _index_below(&rd.v, dir, &at) : r->sibling;
+    }
+    return _read_end(s, &rd, _OK);
+}
+
+//the directory a new item goes to: the current one for a plain name,
+//otherwise everything before the last / of an absolute path
+static vfs_error_t _parent_of(vfs_session_t* s, const view* v, const char* path, node** parent, const char** name)
+{
+    const char* slash = strrchr(path, '/');
+    if(!slash)
+    {
+        *parent = atomic_load(&s->cwd);
+        *name   = path;
+        return _OK;
+    }
+    if(path[0] != '/') return _NOT_FOUND;
+
+    *name = slash + 1;
+    if(slash == path)
+    {
+        *parent = s->vfs->root;
+        return _OK;
+    }
+
+    char* dir = strndup(path, slash - path);
+    if(!dir) return _INVALID_ARGUMENTS;
+    vfs_error_t status = _lookup(s, v, dir, parent);
+    free(dir);
+    if(status == _OK && (*parent)->type != _DIR) status = _NOT_A_DIRECTORY;
+    return status;
+}
+
+static vfs_error_t _make(vfs_session_t* s, const view* v, node* cwd, const char* name, node_types type)
+{
+    vfs_t* vfs = s->vfs;
+    vfs_error_t status = _check_name(name);
+    if(status != _OK) return status;
+
+    if(_find_child(v, name, cwd)) return _OBJECT_ALREADY_EXISTS;
+    if(_is_allowed(_rev(v, cwd),s->user,VFS_W|VFS_X) == false) return _PERMISSION_DENIED;
+
+    node* fresh = _create_node(name, type, s->user);
+    if(!fresh) return _INVALID_ARGUMENTS;
+
+    _track(vfs, fresh);
+    fresh->id = ++vfs->next_id;
+    if(!_add_child(vfs, cwd, fresh)) return _INVALID_ARGUMENTS;
+    _notify(vfs, _CREATED, fresh);
+    return _OK;
+}
+
+vfs_error_t vfs_touch(vfs_session_t* s, const char* path)
+{
+    if(!path) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+
+    node*       cwd;
+    const char* name;
+    status = _parent_of(s, &v, path, &cwd, &name);
+    if(status == _OK) status = _make(s, &v, cwd, name, _FILE);
+    return _write_end(s, status);
+}
+
+vfs_error_t vfs_mkdir(vfs_session_t* s, const char* name)
+{
+    if(!name) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+
+    status = _make(s, &v, atomic_load(&s->cwd), name, _DIR);
+    return _write_end(s, status);
+}
+
+static vfs_error_t _move(vfs_session_t* s, const view* v, const char* source, const char* destination)
+{
+    vfs_t* vfs = s->vfs;
+    node* SourceNode;
+    node* TargetDestination;
+    vfs_error_t status = _lookup(s, v, source, &SourceNode);
+    if(status != _OK) return status;
+    status = _lookup(s, v, destination, &TargetDestination);
+    if(status != _OK) return status;
+
+    if(TargetDestination->type != _DIR) return _NOT_A_DIRECTORY;
+
+    node* oldParent = _rev(v, SourceNode)->parent;
+    if(!oldParent) return _INVALID_ARGUMENTS;
+
+    //a directory cannot go below itself
+    if(_is_ancestor(SourceNode, TargetDestination)) return _INVALID_ARGUMENTS;
+
+    if(!_is_allowed(_rev(v, SourceNode), s->user, VFS_W) ||
+       !_is_allowed(_rev(v, oldParent), s->user, VFS_W|VFS_X) ||
+       !_is_allowed(_rev(v, TargetDestination), s->user, VFS_W|VFS_X))
+    {
+        return _PERMISSION_DENIED;
+    }
+
+    //check the destination before unlinking, a failure must leave the tree intact
+    if(_find_child(v, SourceNode->name, TargetDestination)) return _OBJECT_ALREADY_EXISTS;
+
+    //watchers of the old place hear about the move as well
+    _mark_move(vfs, SourceNode);
+
+    if(!_unlink_child(vfs, oldParent, SourceNode) || !_add_child(vfs, TargetDestination, SourceNode))
+    {
+        return _INVALID_ARGUMENTS;
+    }
+    _notify(vfs, _MOVED, SourceNode);
+
+    //the nodes below got new ancestors, rights cached elsewhere stay valid
+    _ancestors_changed(vfs, SourceNode);
+    return _OK;
+}
+
+vfs_error_t vfs_move(vfs_session_t* s, const char* source, const char* destination)
+{
+    if(!source || !destination) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+    return _write_end(s, _move(s, &v, source, destination));
+}
+
+//a write into a file of the batch: sizes, hashes and watchers follow
+static void _written(vfs_t* vfs, node* file, size_t offset, size_t len, size_t old_size)
+{
+    rev* r = file->work;
+    _update_crc(r, offset, len, old_size);
+    _propagate_size(r->parent, old_size, r->size);
+    _dirty_hash(file);
+    _notify(vfs, _MODIFIED, file);
+}
+
+static vfs_error_t _insert(vfs_session_t* s, const view* v, const char* path, const uint8_t* content, size_t len, bool append)
+{
+    node* file;
+    vfs_error_t status = _lookup(s, v, path, &file);
+    if(status != _OK) return status;
+
+    if(!_is_allowed(_rev(v, file),s->user,VFS_W))
+    {
+        return _PERMISSION_DENIED;
+    }
+
+    if(file->type != _FILE) return _NOT_A_FILE;
+
+    size_t old_size = _rev(v, file)->size;
+    size_t new_size = append ? old_size + len : len;
+    if(new_size < len || new_size >= SIZE_MAX / 2) return _TOO_LONG;
+
+    rev* r = _writable(s->vfs, file);
+    if(!r || !_write_bytes(r, append ? old_size : 0, content, len, !append)) return _INVALID_ARGUMENTS;
+
+    _written(s->vfs, file, append ? old_size : 0, len, old_size);
+    return _OK;
+}
+
+vfs_error_t vfs_insert(vfs_session_t* s, const char* path, const uint8_t* content, size_t len, bool append)
+{
+    if(!content && len) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+    return _write_end(s, _insert(s, &v, path, content, len, append));
+}
+
+vfs_error_t vfs_read(vfs_session_t* s, const char* path, const uint8_t** data, size_t* len)
+{
+    if(!data || !len) return _INVALID_ARGUMENTS;
+
+    reading rd;
+    _read_begin(s, &rd, false);
+
+    node* file;
+    vfs_error_t status = _lookup(s, &rd.v, path, &file);
+    if(status != _OK) return _read_end(s, &rd, status);
+
+    rev* r = _rev(&rd.v, file);
+    if(!_is_allowed(r,s->user,VFS_R))
+    {
+        return _read_end(s, &rd, _PERMISSION_DENIED);
+    }
+
+    if(file->type != _FILE) return _read_end(s, &rd, _NOT_A_FILE);
+
+    *data = _bytes(r);
+    *len  = r->size;
+    return _read_end(s, &rd, _OK);
+}
+
+//unlink a child of parent, it is released once no reader can see it any more
+static vfs_error_t _remove_child(vfs_session_t* s, const view* v, node* parent, const char* name)
+{
+    vfs_t* vfs = s->vfs;
+    if(!_can_traverse(s, v, parent)) return _PERMISSION_DENIED;
+
+    node* cur = _find_child(v, name, parent);
+    if(!cur) return _NOT_FOUND;
+
+    if(!_is_allowed(_rev(v, parent),s->user,VFS_W|VFS_X) || !_is_allowed(_rev(v, cur),s->user,VFS_W))
+    {
+        return _PERMISSION_DENIED;
+    }
+    if (_is_session_dir(vfs, cur))
+    {
+        return _IN_USE;
+    }
+
+    _notify(vfs, _DELETED, cur);
+    if(!_room_removed(vfs) || !_unlink_child(vfs, parent, cur)) return _INVALID_ARGUMENTS;
+    vfs->removed[vfs->nremoved++] = cur;
+    return _OK;
+}
+
+static vfs_error_t _rm_by_path(vfs_session_t* s, const view* v, const char* path)
+{
+    if (strcmp(path, "/") == 0)
+    {
+        return _INVALID_ARGUMENTS;
+    }
+
+    char* parent_path = strdup(path);
+    if (!parent_path) return _INVALID_ARGUMENTS;
+
+    char* node_name = strrchr(parent_path, '/');
+
+    *node_name = '\0';
+    node_name++;
+
+    node* parent = s->vfs->root;
+    vfs_error_t status = (strlen(parent_path) == 0) ? _OK : _lookup(s, v, parent_path, &parent);
+    if(status == _OK && parent->type != _DIR) status = _NOT_A_DIRECTORY;
+    if(status == _OK) status = _remove_child(s, v, parent, node_name);
+
+    free(parent_path);
+    return status;
+}
+
+vfs_error_t vfs_rm(vfs_session_t* s, const char* name)
+{
+    if(!name) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+
+    if (strchr(name, '/'))
+    {
+        status = _rm_by_path(s, &v, name);
+    }
+    else
+    {
+        status = _remove_child(s, &v, atomic_load(&s->cwd), name);
+    }
+    return _write_end(s, status);
+}
+
+//the write lock keeps a directory from being removed while a session moves into it
+vfs_error_t vfs_cd(vfs_session_t* s, const char* name)
+{
+    if(!name) return _INVALID_ARGUMENTS;
+
+    vfs_t* vfs = s->vfs;
+    view   v;
+    pthread_mutex_lock(&vfs->write_lock);
+    _locked_view(s, &v, false);
+
+    vfs_error_t status = _OK;
+    node*       target;
+    if(strcmp(name,"..")==0)
+    {
+        node* parent = _rev(&v, atomic_load(&s->cwd))->parent;
+        if(parent) atomic_store(&s->cwd, parent);
+    }
+    else if((status = _lookup(s, &v, name, &target)) != _OK)
+    {
+    }
+    else if(target->type != _DIR)
+    {
+        status = _NOT_A_DIRECTORY;
+    }
+    else if(!_can_traverse(s, &v, target))
+    {
+        status = _PERMISSION_DENIED;
+    }
+    else
+    {
+        atomic_store(&s->cwd, target);
+    }
+    pthread_mutex_unlock(&vfs->write_lock);
+    return status;
+}
+
+//file handles
+static vfs_handle* _handle(vfs_session_t* s, int fd)
+{
+    if(fd < 0 || fd >= s->nhandles || !atomic_load(&s->handles[fd].file)) return NULL;
+    return &s->handles[fd];
+}
+
+//under the write lock, with a batch open when mode truncates
+static vfs_error_t _open(vfs_session_t* s, const view* v, const char* path, open_modes mode, int* fd)
+{
+    vfs_t* vfs = s->vfs;
+    node*  file;
+    vfs_error_t status = _lookup(s, v, path, &file);
+    if(status != _OK) return status;
+    if(file->type != _FILE) return _NOT_A_FILE;
+
+    //a read transaction may still see a subtree that is gone from the newest version
+    if(_in_removed(file)) return _NOT_FOUND;
+    if(!_is_allowed(_rev(v, file), s->user, (mode == _READ) ? VFS_R : VFS_W)) return _PERMISSION_DENIED;
+
+    int slot = 0;
+    while(slot < s->nhandles && s->handles[slot].file)
+    {
+        slot++;
+    }
+    if(slot == s->nhandles)
+    {
+        int count = s->nhandles ? 2 * s->nhandles : 8;
+        vfs_handle* grown = realloc(s->handles, count * sizeof(vfs_handle));
+        if(!grown) return _INVALID_ARGUMENTS;
+        memset(grown + s->nhandles, 0, (count - s->nhandles) * sizeof(vfs_handle));
+        s->handles  = grown;
+        s->nhandles = count;
+    }
+
+    if(mode == _WRITE && _rev(v, file)->size)
+    {
+        rev* r = _writable(vfs, file);
+        if(!r) return _INVALID_ARGUMENTS;
+
+        size_t old_size = r->size;
+        if(atomic_fetch_sub(&r->data->refs, 1) == 1) free(r->data);
+        r->data    = NULL;
+        r->size    = 0;
+        r->crc     = 0;
+        r->crc_len = 0;
+        atomic_store_explicit(&r->sealed, 0, memory_order_relaxed);
+        _propagate_size(r->parent, old_size, 0);
+        _dirty_hash(file);
+        _notify(vfs, _MODIFIED, file);
+    }
+
+    file->refs++;
+    atomic_store(&s->handles[slot].file, file);
+    s->handles[slot].offset = (mode == _APPEND) ? _rev(v, file)->size : 0;
+    s->handles[slot].mode   = mode;
+    *fd = slot;
+    return _OK;
+}
+
+vfs_error_t vfs_open(vfs_session_t* s, const char* path, open_modes mode, int* fd)
+{
+    if(!fd) return _INVALID_ARGUMENTS;
+    if(mode != _READ && mode != _WRITE && mode != _APPEND) return _INVALID_ARGUMENTS;
+
+    vfs_t* vfs = s->vfs;
+    view   v;
+    if(mode == _WRITE)
+    {
+        vfs_error_t status = _write_begin(s, &v);
+        if(status != _OK) return status;
+        return _write_end(s, _open(s, &v, path, mode, fd));
+    }
+
+    //handles follow the newest version, a read transaction does not hold them back
+    pthread_mutex_lock(&vfs->write_lock);
+    _locked_view(s, &v, true);
+    vfs_error_t status = _open(s, &v, path, mode, fd);
+    pthread_mutex_unlock(&vfs->write_lock);
+    return status;
+}
+
+vfs_error_t vfs_pread(vfs_session_t* s, int fd, size_t offset, size_t len, const uint8_t** data, size_t* got)
+{
+    vfs_handle* h = _handle(s, fd);
+    if(!h || !data || !got) return _INVALID_ARGUMENTS;
+    if(h->mode != _READ) return _PERMISSION_DENIED;
+
+    reading rd;
+    _read_begin(s, &rd, true);
+    if(offset == VFS_CURRENT) offset = h->offset;
+    rev* file = _rev(&rd.v, atomic_load(&h->file));
+
+    size_t size = file->size;
+    if(offset > size) offset = size;
+    if(len > size - offset) len = size - offset;
+
+    *data = file->data ? _bytes(file) + offset : NULL;
+    *got  = len;
+    h->offset = offset + len;
+    return _read_end(s, &rd, _OK);
+}
+
+static vfs_error_t _pwrite(vfs_session_t* s, vfs_handle* h, size_t offset, const uint8_t* data, size_t len)
+{
+    node*  file     = h->file;
+    size_t old_size = _newest(file)->size;
+    if(h->mode == _APPEND)        offset = old_size;
+    else if(offset == VFS_CURRENT) offset = h->offset;
+
+    size_t end = offset + len;
+    if(end < offset || end >= SIZE_MAX / 2) return _TOO_LONG;
+
+    //writing past the end leaves a zero filled gap
+    rev* r = _writable(s->vfs, file);
+    if(!r || !_write_bytes(r, offset, data, len, false)) return _INVALID_ARGUMENTS;
+
+    _written(s->vfs, file, offset, len, old_size);
+    h->offset = end;
+    return _OK;
+}
+
+vfs_error_t vfs_pwrite(vfs_session_t* s, int fd, size_t offset, const uint8_t* data, size_t len)
+{
+    vfs_handle* h = _handle(s, fd);
+    if(!h || (!data && len)) return _INVALID_ARGUMENTS;
+    if(h->mode == _READ) return _PERMISSION_DENIED;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+    return _write_end(s, _pwrite(s, h, offset, data, len));
+}
+
+vfs_error_t vfs_seek(vfs_session_t* s, int fd, size_t offset)
+{
+    vfs_handle* h = _handle(s, fd);
+    if(!h || offset == VFS_CURRENT) return _INVALID_ARGUMENTS;
+
+    h->offset = offset;
+    return _OK;
+}
+
+vfs_error_t vfs_close(vfs_session_t* s, int fd)
+{
+    vfs_handle* h = _handle(s, fd);
+    if(!h) return _INVALID_ARGUMENTS;
+
+    pthread_mutex_lock(&s->vfs->write_lock);
+    _close_handle(h);
+    pthread_mutex_unlock(&s->vfs->write_lock);
+    return _OK;
+}
+
+//watches
+static watch* _watch_of(vfs_session_t* s, int wd)
+{
+    if(wd < 0 || wd >= s->nwatches) return NULL;
+    return s->watches[wd];
+}
+
+static vfs_error_t _watch(vfs_session_t* s, const view* v, const char* path, bool recursive, int* wd)
+{
+    vfs_t* vfs = s->vfs;
+    node*  target;
+    vfs_error_t status = _lookup(s, v, path, &target);
+    if(status != _OK) return status;
+    if(_in_removed(target)) return _NOT_FOUND;
+    if(!_is_allowed(_rev(v, target), s->user, VFS_R)) return _PERMISSION_DENIED;
+
+    int slot = 0;
+    while(slot < s->nwatches && s->watches[slot])
+    {
+        slot++;
+    }
+    if(slot == s->nwatches)
+    {
+        int count = s->nwatches ? 2 * s->nwatches : 8;
+        watch** grown = realloc(s->watches, count * sizeof(watch*));
+        if(!grown) return _INVALID_ARGUMENTS;
+        memset(grown + s->nwatches, 0, (count - s->nwatches) * sizeof(watch*));
+        s->watches  = grown;
+        s->nwatches = count;
+    }
+
+    if(vfs->nwatching == vfs->watching_cap)
+    {
+        size_t     cap   = vfs->watching_cap ? 2 * vfs->watching_cap : 8;
+        watch_ref* grown = realloc(vfs->watching, cap * sizeof(watch_ref));
+        if(!grown) return _INVALID_ARGUMENTS;
+        vfs->watching     = grown;
+        vfs->watching_cap = cap;
+    }
+
+    watch* w = calloc(1, sizeof(watch));
+    if(!w) return _INVALID_ARGUMENTS;
+    w->ref = vfs->nwatching++;
+    vfs->watching[w->ref] = (watch_ref){ target, w, recursive };
+    s->watches[slot]      = w;
+    *wd = slot;
+    return _OK;
+}
+
+vfs_error_t vfs_watch(vfs_session_t* s, const char* path, bool recursive, int* wd)
+{
+    if(!wd) return _INVALID_ARGUMENTS;
+
+    vfs_t* vfs = s->vfs;
+    view   v;
+    pthread_mutex_lock(&vfs->write_lock);
+    _locked_view(s, &v, true);
+    vfs_error_t status = _watch(s, &v, path, recursive, wd);
+    pthread_mutex_unlock(&vfs->write_lock);
+    return status;
+}
+
+vfs_error_t vfs_unwatch(vfs_session_t* s, int wd)
+{
+    vfs_t* vfs = s->vfs;
+    watch* w   = _watch_of(s, wd);
+    if(!w) return _INVALID_ARGUMENTS;
+
+    //the writer stages into the watch under the lock
+    pthread_mutex_lock(&vfs->write_lock);
+    s->watches[wd] = NULL;
+    _unlist_watch(vfs, w);
+    pthread_mutex_unlock(&vfs->write_lock);
+    free(w);
+    return _OK;
+}
+
+//the session's own thread is the only reader of its watches, no lock needed
+vfs_error_t vfs_events(vfs_session_t* s, int wd, vfs_event_t* out, size_t max, size_t* got, uint64_t* lost)
+{
+    if(!out || !got || !lost) return _INVALID_ARGUMENTS;
+    watch* w = _watch_of(s, wd);
+    if(!w) return _INVALID_ARGUMENTS;
+
+    uint64_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+    *got = 0;
+    while(*got < max && tail < head)
+    {
+        out[(*got)++] = w->events[tail % VFS_WATCH_QUEUE];
+        tail++;
+    }
+    atomic_store_explicit(&w->tail, tail, memory_order_release);
+    *lost = atomic_exchange_explicit(&w->lost, 0, memory_order_relaxed);
+    return _OK;
+}
+
+//checksums
+vfs_error_t vfs_checksum(vfs_session_t* s, const char* path, uint32_t* crc)
+{
+    if(!crc) return _INVALID_ARGUMENTS;
+
+    reading rd;
+    _read_begin(s, &rd, false);
+
+    node* file;
+    vfs_error_t status = _lookup(s, &rd.v, path, &file);
+    if(status != _OK) return _read_end(s, &rd, status);
+    if(file->type != _FILE) return _read_end(s, &rd, _NOT_A_FILE);
+
+    rev* r = _rev(&rd.v, file);
+    if(!_is_allowed(r, s->user, VFS_R)) return _read_end(s, &rd, _PERMISSION_DENIED);
+
+    *crc = _checksum(r);
+    return _read_end(s, &rd, _OK);
+}
+
+typedef struct
+{
+    rev**           files;
+    node**          nodes;
+    bool*           corrupt;
+    size_t          count;
+    _Atomic size_t  next;
+} verify_job;
+
+//every file goes to exactly one worker, so the workers never share a revision
+static void* _verify_worker(void* arg)
+{
+    verify_job* job = arg;
+    size_t k;
+    while((k = atomic_fetch_add(&job->next, 1)) < job->count)
+    {
+        rev* file = job->files[k];
+
+        //once sealed, the checksum of the whole file is the reference; before that the
+        //checksummed prefix must still match, and whatever came after it is sealed now
+        uint64_t sealed = atomic_load_explicit(&file->sealed, memory_order_acquire);
+        bool     bad    = (sealed >> 32) ? _crc32c(0, _bytes(file), file->size) != (uint32_t)sealed
+                                         : file->crc_len && _crc32c(0, _bytes(file), file->crc_len) != file->crc;
+        if(bad)
+        {
+            job->corrupt[k] = true;
+            continue;
+        }
+        _checksum(file);
+    }
+    return NULL;
+}
+
+//gather the readable files below nd
+static bool _collect_files(vfs_session_t* s, const view* v, node* nd, verify_job* job, size_t* cap, size_t* bytes)
+{
+    rev* r = _rev(v, nd);
+    if(nd->type == _FILE)
+    {
+        if(!_is_allowed(r, s->user, VFS_R)) return true;
+        if(job->count == *cap)
+        {
+            size_t grown_cap = *cap ? 2 * *cap : 256;
+            rev**  grown     = realloc(job->files, grown_cap * sizeof(rev*));
+            if(!grown) return false;
+            job->files = grown;
+            node** nodes = realloc(job->nodes, grown_cap * sizeof(node*));
+            if(!nodes) return false;
+            job->nodes = nodes;
+            *cap = grown_cap;
+        }
+        job->files[job->count] = r;
+        job->nodes[job->count] = nd;
+        job->count++;
+        *bytes += r->size;
+        return true;
+    }
+
+    if(!_is_allowed(r, s->user, VFS_R | VFS_X)) return true;
+    for(node* cur = r->children; cur; cur = _rev(v, cur)->sibling)
+    {
+        if(!_collect_files(s, v, cur, job, cap, bytes)) return false;
+    }
+    return true;
+}
+
+static vfs_error_t _verify(vfs_session_t* s, const view* v, const char* path, vfs_verify_cb cb, void* ctx, size_t* checked)
+{
+    node* target = atomic_load(&s->cwd);
+    if(path)
+    {
+        vfs_error_t status = _lookup(s, v, path, &target);
+        if(status != _OK) return status;
+    }
+    else if(!_can_traverse(s, v, target))
+    {
+        return _PERMISSION_DENIED;
+    }
+
+    verify_job job;
+    size_t cap = 0, bytes = 0;
+    job.files   = NULL;
+    job.nodes   = NULL;
+    job.count   = 0;
+    job.corrupt = NULL;
+    if(!_collect_files(s, v, target, &job, &cap, &bytes) ||
+       !(job.corrupt = calloc(job.count ? job.count : 1, sizeof(bool))))
+    {
+        free(job.files);
+        free(job.nodes);
+        return _INVALID_ARGUMENTS;
+    }
+    atomic_init(&job.next, 0);
+
+    //the caller is one of the workers, threads that fail to start are simply missing
+    size_t count = job.count;
+    long   cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+    int    want  = (bytes < VFS_VERIFY_SERIAL || cpus < 2) ? 1 : (int)cpus;
+    if(want > VFS_VERIFY_THREADS) want = VFS_VERIFY_THREADS;
+    if((size_t)want > count) want = count ? (int)count : 1;
+
+    pthread_t threads[VFS_VERIFY_THREADS];
+    int started = 0;
+    while(started < want - 1 && pthread_create(&threads[started], NULL, _verify_worker, &job) == 0)
+    {
+        started++;
+    }
+    _verify_worker(&job);
+    for(int t = 0; t < started; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    vfs_error_t status = _OK;
+    for(size_t k = 0; k < count; k++)
+    {
+        if(!job.corrupt[k]) continue;
+        status = _CORRUPTED;
+        if(!cb) continue;
+
+        char* file_path = _get_absolute_path(v, job.nodes[k]);
+        int   stop      = file_path ? cb(file_path, ctx) : 0;
+        free(file_path);
+        if(stop) break;
+    }
+
+    if(checked) *checked = count;
+    free(job.corrupt);
+    free(job.files);
+    free(job.nodes);
+    return status;
+}
+
+vfs_error_t vfs_verify(vfs_session_t* s, const char* path, vfs_verify_cb cb, void* ctx, size_t* checked)
+{
+    reading rd;
+    _read_begin(s, &rd, false);
+    return _read_end(s, &rd, _verify(s, &rd.v, path, cb, ctx, checked));
+}
+
+//tree diff
+typedef struct
+{
+    vfs_session_t* s;
+    const view*    v;
+    vfs_diff_cb    cb;
+    void*          ctx;
+    size_t         skip_a;   // length of the roots' own paths, reports are relative to them
+    size_t         skip_b;
+    bool           stop;
+} diff_walk;
+
+static void _diff_report(diff_walk* w, event_types type, node* nd, size_t skip)
+{
+    if(w->stop) return;
+
+    char* path = _get_absolute_path(w->v, nd);
+    if(!path) return;
+    if(w->cb(type, path + skip, w->ctx)) w->stop = true;
+    free(path);
+}
+
+static uint64_t _name_hash(const char* name)
+{
+    return _hash_bytes((const uint8_t*)name, strlen(name), HASH_SEED_NAME);
+}
+
+static void _diff_nodes(diff_walk* w, node* a, node* b);
+
+//pair the children of a and b by name through a small open addressing table of b's
+static void _diff_dirs(diff_walk* w, node* a, node* b)
+{
+    rev*   ra    = _rev(w->v, a);
+    rev*   rb    = _rev(w->v, b);
+    size_t count = 0;
+    for(node* cur = rb->children; cur; cur = _rev(w->v, cur)->sibling)
+    {
+        count++;
+    }
+
+    size_t cap = 16;
+    while(cap < 2 * count)
+    {
+        cap *= 2;
+    }
+    node** table = calloc(cap, sizeof(node*));
+    bool*  seen  = calloc(cap, sizeof(bool));
+    if(!table || !seen)
+    {
+        free(table);
+        free(seen);
+        _diff_report(w, _MODIFIED, a, w->skip_a);
+        return;
+    }
+
+    for(node* cur = rb->children; cur; cur = _rev(w->v, cur)->sibling)
+    {
+        size_t slot = _name_hash(cur->name) & (cap - 1);
+        while(table[slot])
+        {
+            slot = (slot + 1) & (cap - 1);
+        }
+        table[slot] = cur;
+    }
+
+    for(node* cur = ra->children; cur && !w->stop; cur = _rev(w->v, cur)->sibling)
+    {
+        size_t slot = _name_hash(cur->name) & (cap - 1);
+        while(table[slot] && strcmp(table[slot]->name, cur->name) != 0)
+        {
+            slot = (slot + 1) & (cap - 1);
+        }
+
+        if(!table[slot])
+        {
+            _diff_report(w, _DELETED, cur, w->skip_a);
+            continue;
+        }
+        seen[slot] = true;
+        _diff_nodes(w, cur, table[slot]);
+    }
+
+    for(size_t slot = 0; slot < cap && !w->stop; slot++)
+    {
+        if(table[slot] && !seen[slot]) _diff_report(w, _CREATED, table[slot], w->skip_b);
+    }
+
+    free(table);
+    free(seen);
+}
+
+//equal hashes mean equal subtrees, so they are skipped without looking inside
+static void _diff_nodes(diff_walk* w, node* a, node* b)
+{
+    if(w->stop) return;
+    if(a->type == b->type && _hash(w->v, a) == _hash(w->v, b)) return;
+
+    if(a->type == _DIR && b->type == _DIR &&
+       _is_allowed(_rev(w->v, a), w->s->user, VFS_R | VFS_X) && _is_allowed(_rev(w->v, b), w->s->user, VFS_R | VFS_X))
+    {
+        _diff_dirs(w, a, b);
+        return;
+    }
+    _diff_report(w, _MODIFIED, a, w->skip_a);
+}
+
+static size_t _prefix_length(const view* v, node* root)
+{
+    char* path = _get_absolute_path(v, root);
+    if(!path) return 0;
+    size_t len = strlen(path);
+    free(path);
+    return (len == 1) ? 1 : len + 1;
+}
+
+static vfs_error_t _diff(vfs_session_t* s, const view* v, const char* path_a, const char* path_b, vfs_diff_cb cb, void* ctx)
+{
+    node* a;
+    node* b;
+    vfs_error_t status = _lookup(s, v, path_a, &a);
+    if(status != _OK) return status;
+    status = _lookup(s, v, path_b, &b);
+    if(status != _OK) return status;
+
+    if(a->type != _DIR || b->type != _DIR) return _NOT_A_DIRECTORY;
+    if(!_is_allowed(_rev(v, a), s->user, VFS_R | VFS_X) || !_is_allowed(_rev(v, b), s->user, VFS_R | VFS_X))
+    {
+        return _PERMISSION_DENIED;
+    }
+
+    diff_walk w;
+    w.s      = s;
+    w.v      = v;
+    w.cb     = cb;
+    w.ctx    = ctx;
+    w.skip_a = _prefix_length(v, a);
+    w.skip_b = _prefix_length(v, b);
+    w.stop   = false;
+
+    if(_hash(v, a) != _hash(v, b)) _diff_dirs(&w, a, b);
+    return _OK;
+}
+
+vfs_error_t vfs_diff(vfs_session_t* s, const char* path_a, const char* path_b, vfs_diff_cb cb, void* ctx)
+{
+    if(!cb) return _INVALID_ARGUMENTS;
+
+    reading rd;
+    _read_begin(s, &rd, false);
+    return _read_end(s, &rd, _diff(s, &rd.v, path_a, path_b, cb, ctx));
+}
+
+vfs_error_t vfs_hash(vfs_session_t* s, const char* path, uint64_t* hash)
+{
+    if(!hash) return _INVALID_ARGUMENTS;
+
+    reading rd;
+    _read_begin(s, &rd, false);
+
+    node* target;
+    vfs_error_t status = _lookup(s, &rd.v, path, &target);
+    if(status != _OK) return _read_end(s, &rd, status);
+    if(!_is_allowed(_rev(&rd.v, target), s->user, VFS_R)) return _read_end(s, &rd, _PERMISSION_DENIED);
+
+    *hash = _hash(&rd.v, target);
+    return _read_end(s, &rd, _OK);
+}
+
+static vfs_error_t _chmod(vfs_session_t* s, const view* v, const char* path, uint8_t mode)
+{
+    node* target;
+    vfs_error_t status = _lookup(s, v, path, &target);
+    if(status != _OK) return status;
+
+    if(s->user != _SUPERUSER && _rev(v, target)->owner != s->user) return _PERMISSION_DENIED;
+
+    rev* r = _writable(s->vfs, target);
+    if(!r) return _INVALID_ARGUMENTS;
+    r->mode = mode;
+    if(target->type == _DIR) _perm_changed(s->vfs);
+    return _OK;
+}
+
+vfs_error_t vfs_chmod(vfs_session_t* s, const char* path, uint8_t mode)
+{
+    if(mode & ~VFS_MODE_MASK) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+    return _write_end(s, _chmod(s, &v, path, mode));
+}
+
+static vfs_error_t _chown(vfs_session_t* s, const view* v, const char* path, users owner)
+{
+    node* target;
+    vfs_error_t status = _lookup(s, v, path, &target);
+    if(status != _OK) return status;
+
+    if(s->user != _SUPERUSER) return _PERMISSION_DENIED;
+
+    rev* r = _writable(s->vfs, target);
+    if(!r) return _INVALID_ARGUMENTS;
+    r->owner = owner;
+    if(target->type == _DIR) _perm_changed(s->vfs);
+    return _OK;
+}
+
+vfs_error_t vfs_chown(vfs_session_t* s, const char* path, users owner)
+{
+    if(owner != _CASUAL && owner != _SUPERUSER) return _INVALID_ARGUMENTS;
+
+    view v;
+    vfs_error_t status = _write_begin(s, &v);
+    if(status != _OK) return status;
+    return _write_end(s, _chown(s, &v, path, owner));
+}
+
+vfs_error_t vfs_switch_user(vfs_session_t* s, const char* password)
+{
+    if(s->user == _CASUAL)
+    {
+        if(!password) return _INVALID_ARGUMENTS;
+
+        pthread_mutex_lock(&s->vfs->write_lock);
+        bool match = strcmp(password,s->vfs->pass)==0;
+        pthread_mutex_unlock(&s->vfs->write_lock);
+        if(match)
+        {
+            s->user = _SUPERUSER;
+            return _OK;
+        }
+        else
+        {
+            return _WRONG_PASSWORD;
+        }
+    }
+    else
+    {
+        s->user = _CASUAL;
+        return _OK;
+    }
+}
+
+vfs_error_t vfs_change_password(vfs_session_t* s, const char* new_password)
+{
+    if(!new_password) return _INVALID_ARGUMENTS;
+    if(s->user == _CASUAL) return _PERMISSION_DENIED;
+
+    if(strlen(new_password) >= 127) return _TOO_LONG;
+
+    pthread_mutex_lock(&s->vfs->write_lock);
+    strcpy(s->vfs->pass,new_password);
+    pthread_mutex_unlock(&s->vfs->write_lock);
+    return _OK;
+}
+
+//transactions: a write transaction is the open batch of its session, kept open across calls
+vfs_error_t vfs_begin(vfs_session_t* s)
+{
+    vfs_t* vfs = s->vfs;
+    if(atomic_load(&s->txn) != TXN_NONE) return _ALREADY_IN_TRANSACTION;
+
+    pthread_mutex_lock(&vfs->write_lock);
+    _wait_txn(s);
+    vfs->txn_owner = s;
+    atomic_store(&s->txn, TXN_WRITE);
+    pthread_mutex_unlock(&vfs->write_lock);
+    return _OK;
+}
+
+vfs_error_t vfs_begin_read(vfs_session_t* s)
+{
+    if(atomic_load(&s->txn) != TXN_NONE) return _ALREADY_IN_TRANSACTION;
+
+    s->snap = _pin(s->vfs);
+    atomic_store(&s->txn, TXN_READ);
+    return _OK;
+}
+
+//a session left inside a subtree that is gone now goes back to the root
+static void _end_read(vfs_session_t* s)
+{
+    vfs_t*    vfs  = s->vfs;
+    snapshot* snap = s->snap;
+
+    pthread_mutex_lock(&vfs->write_lock);
+    if(_in_removed(atomic_load(&s->cwd))) atomic_store(&s->cwd, vfs->root);
+    atomic_store(&s->txn, TXN_NONE);
+    s->snap = NULL;
+    pthread_mutex_unlock(&vfs->write_lock);
+    _unpin(vfs, snap);
+}
+
+vfs_error_t vfs_commit(vfs_session_t* s)
+{
+    vfs_t*  vfs = s->vfs;
+    uint8_t txn = atomic_load(&s->txn);
+    if(txn == TXN_NONE) return _NOT_IN_TRANSACTION;
+    if(txn == TXN_READ)
+    {
+        _end_read(s);
+        return _OK;
+    }
+
+    pthread_mutex_lock(&vfs->write_lock);
+    vfs_error_t status = _commit_batch(vfs);
+    _end_txn(vfs);
+    atomic_store(&s->txn, TXN_NONE);
+    pthread_mutex_unlock(&vfs->write_lock);
+    return status;
+}
+
+vfs_error_t vfs_abort(vfs_session_t* s)
+{
+    vfs_t*  vfs = s->vfs;
+    uint8_t txn = atomic_load(&s->txn);
+    if(txn == TXN_NONE) return _NOT_IN_TRANSACTION;
+    if(txn == TXN_READ)
+    {
+        _end_read(s);
+        return _OK;
+    }
+
+    pthread_mutex_lock(&vfs->write_lock);
+    _abort_batch(vfs);
+    _end_txn(vfs);
+    atomic_store(&s->txn, TXN_NONE);
+    pthread_mutex_unlock(&vfs->write_lock);
+    return _OK;
+}
@@ -0,0 +1,204 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//prefixed, glibc's <errno.h> has an error_t of its own
+typedef enum
+{
+    _OK,
+    _COMMAND_NOT_FOUND,
+    _INVALID_ARGUMENTS,
+    _NOT_A_DIRECTORY,
+    _NOT_FOUND,
+    _PERMISSION_DENIED,
+    _OBJECT_ALREADY_EXISTS,
+    _ILLEGAL_CHARACTER,
+    _TOO_LONG,
+    _NOT_A_FILE,
+    _WRONG_PASSWORD,
+    _NOT_IN_TRANSACTION,
+    _ALREADY_IN_TRANSACTION,
+    _CONFLICT,    // no longer returned, writers wait for an open transaction; kept so codes stay put
+    _CORRUPTED,
+    _IN_USE       // a session works inside the directory
+} vfs_error_t;
+
+typedef enum
+{
+    _DIR,
+    _FILE
+} node_types;
+
+typedef enum
+{
+    _CASUAL,
+    _SUPERUSER
+} users;
+
+//mode bits: rwx of the owner followed by rwx of everyone else, e.g. 075
+#define VFS_R 04
+#define VFS_W 02
+#define VFS_X 01
+#define VFS_OWNER(bits) ((bits) << 3)
+#define VFS_OTHER(bits) (bits)
+#define VFS_MODE_MASK 077
+
+typedef enum
+{
+    _READ,
+    _WRITE,    // truncates the file on open
+    _APPEND    // every write goes to the end of the file
+} open_modes;
+
+typedef enum
+{
+    _CREATED,
+    _MODIFIED,
+    _DELETED,
+    _MOVED
+} event_types;
+
+typedef struct
+{
+    event_types type;
+    uint64_t    node;   // id of the node, as in vfs_entry_t
+} vfs_event_t;
+
+//offset argument meaning "where the handle currently is"
+#define VFS_CURRENT ((size_t)-1)
+
+//one independent file system tree
+typedef struct vfs vfs_t;
+
+//a client of a tree: current directory, user and open transaction; sessions of one tree may
+//run on different threads, each session on one thread at a time
+typedef struct vfs_session vfs_session_t;
+
+typedef struct
+{
+    const char* name;
+    uint64_t    id;
+    node_types  type;
+    size_t      size;
+    users       owner;
+    uint8_t     mode;
+} vfs_entry_t;
+
+//called once per listed entry, a non-zero return stops the listing
+typedef int (*vfs_ls_cb)(const vfs_entry_t* entry, void* ctx);
+
+typedef struct
+{
+    uint64_t reclaim_bytes;   // file contents of removed subtrees that are not freed yet
+    uint64_t reclaimed;       // nodes freed in the background so far
+} vfs_stats_t;
+
+vfs_t* vfs_create(void);
+
+//waits until every removed subtree is freed, then frees the instance
+void   vfs_destroy(vfs_t* vfs);
+
+//for a process that is about to exit: stop freeing removed subtrees after the
+//current batch and leave the instance as it is, it must not be used afterwards
+void   vfs_abandon(vfs_t* vfs);
+void   vfs_stats(vfs_t* vfs, vfs_stats_t* out);
+
+vfs_session_t* vfs_session_open(vfs_t* vfs);
+void           vfs_session_close(vfs_session_t* s);
+users          vfs_session_user(const vfs_session_t* s);
+bool           vfs_in_transaction(const vfs_session_t* s);
+
+//absolute path of the current directory, free() it after use
+char* vfs_getcwd(vfs_session_t* s);
+
+vfs_error_t vfs_ls(vfs_session_t* s, vfs_ls_cb cb, void* ctx);
+
+//list at most limit entries (0 = no limit) starting after cursor (0 = from the start),
+//*next is the cursor of the following page or 0 at the end; a cursor stays valid while
+//entries come and go, entries added after the listing started are not reported;
+//without sizes every entry reports size 0
+vfs_error_t vfs_ls_page(vfs_session_t* s, uint64_t cursor, size_t limit, bool sizes,
+                        vfs_ls_cb cb, void* ctx, uint64_t* next);
+vfs_error_t vfs_cd(vfs_session_t* s, const char* name);
+vfs_error_t vfs_mkdir(vfs_session_t* s, const char* name);
+
+//path is a name in the current directory or an absolute path
+vfs_error_t vfs_touch(vfs_session_t* s, const char* path);
+vfs_error_t vfs_rm(vfs_session_t* s, const char* name);
+vfs_error_t vfs_move(vfs_session_t* s, const char* source, const char* destination);
+
+//overwrite or append to a file, path is a name in the current directory or an absolute path;
+//content may point into the file itself, e.g. a pointer returned by vfs_read
+vfs_error_t vfs_insert(vfs_session_t* s, const char* path, const uint8_t* content, size_t len, bool append);
+
+//the returned pointer stays valid until the file is changed or removed by another thread;
+//inside a read transaction it stays valid until the transaction ends
+vfs_error_t vfs_read(vfs_session_t* s, const char* path, const uint8_t** data, size_t* len);
+
+//handles pin a file of this session, so reads and writes skip the path
+//lookup and permission checks; a removed file lives on until it is closed.
+//Handles always see the newest version, a read transaction does not hold them back
+vfs_error_t vfs_open(vfs_session_t* s, const char* path, open_modes mode, int* fd);
+vfs_error_t vfs_pread(vfs_session_t* s, int fd, size_t offset, size_t len, const uint8_t** data, size_t* got);
+vfs_error_t vfs_pwrite(vfs_session_t* s, int fd, size_t offset, const uint8_t* data, size_t len);
+vfs_error_t vfs_seek(vfs_session_t* s, int fd, size_t offset);
+vfs_error_t vfs_close(vfs_session_t* s, int fd);
+
+//report changes of a node and its children (or its whole subtree if recursive); watch
+//numbers belong to the session like handles. Every watch queues up to 1024 events,
+//lost counts the ones it dropped because nobody read them in time
+vfs_error_t vfs_watch(vfs_session_t* s, const char* path, bool recursive, int* wd);
+vfs_error_t vfs_unwatch(vfs_session_t* s, int wd);
+vfs_error_t vfs_events(vfs_session_t* s, int wd, vfs_event_t* out, size_t max, size_t* got, uint64_t* lost);
+
+//crc32c of a file's contents, equal files have equal checksums
+vfs_error_t vfs_checksum(vfs_session_t* s, const char* path, uint32_t* crc);
+
+//called with the absolute path of every damaged file, a non-zero return stops the reports
+typedef int (*vfs_verify_cb)(const char* path, void* ctx);
+
+//check every readable file below path (NULL = current directory) against its checksum
+//on several threads; returns _CORRUPTED if some file no longer matches
+vfs_error_t vfs_verify(vfs_session_t* s, const char* path, vfs_verify_cb cb, void* ctx, size_t* checked);
+
+//merkle hash of a node: its contents for a file, the names and hashes of its
+//children for a directory; equal hashes mean equal subtrees
+vfs_error_t vfs_hash(vfs_session_t* s, const char* path, uint64_t* hash);
+
+//called with a path relative to the compared directories: _CREATED if it is only in b,
+//_DELETED if it is only in a, _MODIFIED if it differs; non-zero stops the diff
+typedef int (*vfs_diff_cb)(event_types type, const char* path, void* ctx);
+
+//report the differences between two directories, subtrees with equal hashes are skipped
+vfs_error_t vfs_diff(vfs_session_t* s, const char* path_a, const char* path_b, vfs_diff_cb cb, void* ctx);
+
+//path is a name in the current directory or an absolute path
+vfs_error_t vfs_chmod(vfs_session_t* s, const char* path, uint8_t mode);
+vfs_error_t vfs_chown(vfs_session_t* s, const char* path, users owner);
+
+vfs_error_t vfs_switch_user(vfs_session_t* s, const char* password);
+vfs_error_t vfs_change_password(vfs_session_t* s, const char* new_password);
+
+//changes between begin and commit are published all at once; readers keep seeing the
+//previous version meanwhile. Only one write transaction is open at a time: begin and
+//writes of other sessions wait until it is committed or aborted
+vfs_error_t vfs_begin(vfs_session_t* s);
+
+//until commit or abort every path based read sees the version that was newest at
+//begin, whatever is written meanwhile; writes fail with _PERMISSION_DENIED
+vfs_error_t vfs_begin_read(vfs_session_t* s);
+vfs_error_t vfs_commit(vfs_session_t* s);
+vfs_error_t vfs_abort(vfs_session_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif